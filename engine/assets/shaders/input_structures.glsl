@@ -8,10 +8,22 @@ layout (set = 0, binding = 0) uniform SceneData {
     vec4 sunlightColor;
 } sceneData;
 
-layout (set = 1, binding = 0) uniform GLTFMaterialData {
+struct MaterialData {
     vec4 colorFactors;
     vec4 metallicRoughnessFactors;
-} materialData;
+    uint colorTexture;
+    uint metallicRoughnessTexture;
+    uvec2 padding;
+};
 
-layout (set = 1, binding = 1) uniform sampler2D colorTexture;
-layout (set = 1, binding = 2) uniform sampler2D matellicRoughnessTexture;
\ No newline at end of file
+layout (set = 1, binding = 0) readonly buffer MaterialTable {
+    MaterialData materials[];
+} materialTable;
+
+layout (set = 1, binding = 1) uniform sampler2D textures[];
+
+// Affine transforms are uploaded as the top three rows of the matrix, the fourth row is always (0, 0, 0, 1).
+mat4 AffineToMatrix(mat3x4 rows)
+{
+    return transpose(mat4(rows[0], rows[1], rows[2], vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+}
@@ -0,0 +1,7 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#define COMPACT_VERTICES
+#include "mesh_vertex.glsl"
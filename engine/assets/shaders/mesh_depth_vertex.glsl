@@ -0,0 +1,30 @@
+// Body of mesh_depth.vert and mesh_depth_compact.vert.
+
+#include "input_structures.glsl"
+#include "vertex_pulling.glsl"
+
+invariant gl_Position;
+
+layout (buffer_reference, std430) readonly buffer InstanceBuffer
+{
+    mat3x4 transforms[];
+};
+
+layout (push_constant) uniform constants
+{
+    InstanceBuffer instanceBuffer;
+    VertexBuffer vertexBuffer;
+    uint materialIndex;
+    vec4 positionOrigin;
+    vec4 positionExtents;
+} PushConstants;
+
+void main()
+{
+    // Only the position is fetched, the rest of the vertex is left to the shading pass.
+    vec3 vertexPosition = PullPosition(PushConstants.vertexBuffer, gl_VertexIndex, PushConstants.positionOrigin.xyz, PushConstants.positionExtents.xyz);
+    vec4 position = vec4(vertexPosition, 1.0f);
+    mat4 renderMatrix = AffineToMatrix(PushConstants.instanceBuffer.transforms[gl_InstanceIndex]);
+
+    gl_Position = sceneData.viewProjection * renderMatrix * position;
+}
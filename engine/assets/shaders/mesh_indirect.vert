@@ -0,0 +1,6 @@
+#version 460
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "mesh_indirect_vertex.glsl"
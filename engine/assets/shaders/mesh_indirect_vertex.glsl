@@ -0,0 +1,50 @@
+// Body of mesh_indirect.vert and mesh_indirect_compact.vert.
+
+#include "input_structures.glsl"
+#include "vertex_pulling.glsl"
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) flat out uint outMaterialIndex;
+
+struct ObjectData
+{
+    mat3x4 transform;
+    vec4 center;
+    vec4 extent;
+    uint firstIndex;
+    uint indexCount;
+    uint batchIndex;
+    uint firstCommand;
+    VertexBuffer vertexBuffer;
+    int vertexOffset;
+    uint materialIndex;
+    vec4 positionOrigin;
+    vec4 positionExtents;
+};
+
+layout (buffer_reference, std430) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+};
+
+layout (push_constant) uniform constants
+{
+    ObjectBuffer objectBuffer;
+} PushConstants;
+
+void main()
+{
+    ObjectData object = PushConstants.objectBuffer.objects[gl_InstanceIndex];
+    VertexAttributes v = PullVertex(object.vertexBuffer, gl_VertexIndex, object.positionOrigin.xyz, object.positionExtents.xyz);
+    vec4 position = vec4(v.position, 1.0f);
+    mat4 renderMatrix = AffineToMatrix(object.transform);
+
+    gl_Position = sceneData.viewProjection * renderMatrix * position;
+
+    outNormal = (renderMatrix * vec4(v.normal, 0.0f)).xyz;
+    outColor = v.color.xyz * materialTable.materials[object.materialIndex].colorFactors.xyz;
+    outUV = v.uv;
+    outMaterialIndex = object.materialIndex;
+}
@@ -0,0 +1,40 @@
+// Body of mesh.vert and mesh_compact.vert.
+
+#include "input_structures.glsl"
+#include "vertex_pulling.glsl"
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) flat out uint outMaterialIndex;
+
+// The depth prepass computes the exact same position, so shading can test against its depth with EQUAL.
+invariant gl_Position;
+
+layout (buffer_reference, std430) readonly buffer InstanceBuffer
+{
+    mat3x4 transforms[];
+};
+
+layout (push_constant) uniform constants
+{
+    InstanceBuffer instanceBuffer;
+    VertexBuffer vertexBuffer;
+    uint materialIndex;
+    vec4 positionOrigin;
+    vec4 positionExtents;
+} PushConstants;
+
+void main()
+{
+    VertexAttributes v = PullVertex(PushConstants.vertexBuffer, gl_VertexIndex, PushConstants.positionOrigin.xyz, PushConstants.positionExtents.xyz);
+    vec4 position = vec4(v.position, 1.0f);
+    mat4 renderMatrix = AffineToMatrix(PushConstants.instanceBuffer.transforms[gl_InstanceIndex]);
+
+    gl_Position = sceneData.viewProjection * renderMatrix * position;
+
+    outNormal = (renderMatrix * vec4(v.normal, 0.0f)).xyz;
+    outColor = v.color.xyz * materialTable.materials[PushConstants.materialIndex].colorFactors.xyz;
+    outUV = v.uv;
+    outMaterialIndex = PushConstants.materialIndex;
+}
@@ -0,0 +1,81 @@
+// Vertex formats pulled through buffer references, defining COMPACT_VERTICES before the include selects CompactVertex.
+
+#ifdef COMPACT_VERTICES
+struct Vertex
+{
+    uint positionXY;
+    uint positionZNormal;
+    uint uv;
+    uint color;
+};
+#else
+struct Vertex
+{
+    vec3 position;
+    float uv_x;
+    vec3 normal;
+    float uv_y;
+    vec4 color;
+};
+#endif
+
+layout (buffer_reference, std430) readonly buffer VertexBuffer
+{
+    Vertex vertices[];
+};
+
+struct VertexAttributes
+{
+    vec3 position;
+    vec3 normal;
+    vec2 uv;
+    vec4 color;
+};
+
+#ifdef COMPACT_VERTICES
+vec3 DecodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0f);
+    normal.x += normal.x >= 0.0f ? -fold : fold;
+    normal.y += normal.y >= 0.0f ? -fold : fold;
+    return normalize(normal);
+}
+
+// Positions are unorm16 within the bounds of their surface.
+vec3 PullPosition(VertexBuffer vertexBuffer, int index, vec3 boundsOrigin, vec3 boundsExtents)
+{
+    Vertex v = vertexBuffer.vertices[index];
+    vec3 quantized = vec3(unpackUnorm2x16(v.positionXY), unpackUnorm2x16(v.positionZNormal).x);
+    return boundsOrigin + (quantized * 2.0f - 1.0f) * boundsExtents;
+}
+
+VertexAttributes PullVertex(VertexBuffer vertexBuffer, int index, vec3 boundsOrigin, vec3 boundsExtents)
+{
+    Vertex v = vertexBuffer.vertices[index];
+
+    VertexAttributes attributes;
+    attributes.position = PullPosition(vertexBuffer, index, boundsOrigin, boundsExtents);
+    attributes.normal = DecodeOctahedral(unpackSnorm4x8(v.positionZNormal).zw);
+    attributes.uv = unpackHalf2x16(v.uv);
+    attributes.color = unpackUnorm4x8(v.color);
+    return attributes;
+}
+#else
+vec3 PullPosition(VertexBuffer vertexBuffer, int index, vec3 boundsOrigin, vec3 boundsExtents)
+{
+    return vertexBuffer.vertices[index].position;
+}
+
+VertexAttributes PullVertex(VertexBuffer vertexBuffer, int index, vec3 boundsOrigin, vec3 boundsExtents)
+{
+    Vertex v = vertexBuffer.vertices[index];
+
+    VertexAttributes attributes;
+    attributes.position = v.position;
+    attributes.normal = v.normal;
+    attributes.uv = vec2(v.uv_x, v.uv_y);
+    attributes.color = v.color;
+    return attributes;
+}
+#endif
@@ -0,0 +1,65 @@
+﻿#include "core/radix_sort.hpp"
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+
+namespace lumina
+{
+    void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, std::vector<uint64_t>& scratchKeys, std::vector<uint32_t>& scratchValues)
+    {
+        assert(keys.size() == values.size());
+
+        constexpr uint32_t RADIX_BITS = 11;
+        constexpr uint32_t BUCKETS    = 1 << RADIX_BITS;
+        constexpr uint32_t PASSES     = (64 + RADIX_BITS - 1) / RADIX_BITS;
+
+        const size_t count = keys.size();
+        if (count < 2)
+        {
+            return;
+        }
+
+        std::array<std::array<uint32_t, BUCKETS>, PASSES> histograms {};
+        for (uint64_t key : keys)
+        {
+            for (uint32_t pass = 0; pass < PASSES; pass++)
+            {
+                histograms[pass][(key >> (pass * RADIX_BITS)) & (BUCKETS - 1)]++;
+            }
+        }
+
+        scratchKeys.resize(count);
+        scratchValues.resize(count);
+
+        for (uint32_t pass = 0; pass < PASSES; pass++)
+        {
+            std::array<uint32_t, BUCKETS>& histogram = histograms[pass];
+
+            // Every key falls into the same bucket, this pass would only copy.
+            const uint32_t shift = pass * RADIX_BITS;
+            if (histogram[(keys[0] >> shift) & (BUCKETS - 1)] == count)
+            {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (uint32_t& bucket : histogram)
+            {
+                const uint32_t bucketCount = bucket;
+                bucket                     = offset;
+                offset += bucketCount;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                const uint32_t destination = histogram[(keys[i] >> shift) & (BUCKETS - 1)]++;
+                scratchKeys[destination]   = keys[i];
+                scratchValues[destination] = values[i];
+            }
+
+            keys.swap(scratchKeys);
+            values.swap(scratchValues);
+        }
+    }
+} // namespace lumina
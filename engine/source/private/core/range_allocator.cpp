@@ -0,0 +1,101 @@
+﻿#include "core/range_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace lumina
+{
+    RangeAllocator::RangeAllocator(uint32_t initialCapacity) : capacity(initialCapacity), freeSpace(initialCapacity)
+    {
+        if (capacity > 0)
+        {
+            freeRanges.push_back({0, capacity});
+        }
+    }
+
+    uint32_t RangeAllocator::Allocate(uint32_t size)
+    {
+        if (size == 0)
+        {
+            return 0;
+        }
+        if (size > freeSpace)
+        {
+            return INVALID_OFFSET;
+        }
+
+        auto best = freeRanges.end();
+        for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it)
+        {
+            if (it->size >= size && (best == freeRanges.end() || it->size < best->size))
+            {
+                best = it;
+                if (best->size == size)
+                {
+                    break;
+                }
+            }
+        }
+
+        if (best == freeRanges.end())
+        {
+            return INVALID_OFFSET;
+        }
+
+        const uint32_t offset = best->offset;
+        if (best->size == size)
+        {
+            freeRanges.erase(best);
+        }
+        else
+        {
+            best->offset += size;
+            best->size -= size;
+        }
+
+        freeSpace -= size;
+        return offset;
+    }
+
+    void RangeAllocator::Free(uint32_t offset, uint32_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        assert(offset + size <= capacity);
+
+        auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset, [](const Range& range, uint32_t value) {
+            return range.offset < value;
+        });
+
+        assert(next == freeRanges.end() || offset + size <= next->offset);
+        assert(next == freeRanges.begin() || std::prev(next)->offset + std::prev(next)->size <= offset);
+
+        freeSpace += size;
+
+        const bool mergePrevious = next != freeRanges.begin() && std::prev(next)->offset + std::prev(next)->size == offset;
+        const bool mergeNext     = next != freeRanges.end() && offset + size == next->offset;
+
+        if (mergePrevious && mergeNext)
+        {
+            std::prev(next)->size += size + next->size;
+            freeRanges.erase(next);
+        }
+        else if (mergePrevious)
+        {
+            std::prev(next)->size += size;
+        }
+        else if (mergeNext)
+        {
+            next->offset = offset;
+            next->size += size;
+        }
+        else
+        {
+            freeRanges.insert(next, {offset, size});
+        }
+    }
+} // namespace lumina
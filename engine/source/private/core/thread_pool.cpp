@@ -0,0 +1,121 @@
+﻿#include "core/thread_pool.hpp"
+
+#include <algorithm>
+
+namespace lumina
+{
+    ThreadPool::ThreadPool(uint32_t workerCount)
+    {
+        workers.reserve(workerCount);
+        for (uint32_t i = 0; i < workerCount; i++)
+        {
+            workers.emplace_back(&ThreadPool::WorkerLoop, this);
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::ParallelFor(uint32_t itemCount, uint32_t itemsPerChunk, const ChunkFunction& chunkFunction)
+    {
+        if (itemCount == 0)
+        {
+            return;
+        }
+
+        itemsPerChunk = std::max(itemsPerChunk, 1u);
+
+        // Not worth waking the workers for a single chunk.
+        if (workers.empty() || itemCount <= itemsPerChunk)
+        {
+            for (uint32_t chunk = 0; chunk < ChunkCount(itemCount, itemsPerChunk); chunk++)
+            {
+                const uint32_t begin = chunk * itemsPerChunk;
+                chunkFunction(begin, std::min(begin + itemsPerChunk, itemCount), chunk);
+            }
+            return;
+        }
+
+        {
+            // Workers that woke up late for the previous batch could still be looking at its state.
+            std::unique_lock lock(mutex);
+            workFinished.wait(lock, [this] { return activeWorkers == 0; });
+
+            function   = &chunkFunction;
+            count      = itemCount;
+            chunkSize  = itemsPerChunk;
+            chunkCount = ChunkCount(itemCount, itemsPerChunk);
+            nextChunk.store(0, std::memory_order_relaxed);
+            finishedChunks.store(0, std::memory_order_relaxed);
+            generation++;
+        }
+        workAvailable.notify_all();
+
+        RunChunks();
+
+        std::unique_lock lock(mutex);
+        workFinished.wait(lock, [this] { return activeWorkers == 0 && finishedChunks.load(std::memory_order_acquire) == chunkCount; });
+        function = nullptr;
+    }
+
+    uint32_t ThreadPool::DefaultWorkerCount()
+    {
+        const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        uint64_t seenGeneration = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                workAvailable.wait(lock, [&] { return stopping || generation != seenGeneration; });
+                if (stopping)
+                {
+                    return;
+                }
+
+                seenGeneration = generation;
+                activeWorkers++;
+            }
+
+            RunChunks();
+
+            {
+                std::lock_guard lock(mutex);
+                activeWorkers--;
+            }
+            workFinished.notify_all();
+        }
+    }
+
+    void ThreadPool::RunChunks()
+    {
+        while (true)
+        {
+            const uint32_t chunk = nextChunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunk >= chunkCount)
+            {
+                return;
+            }
+
+            const uint32_t begin = chunk * chunkSize;
+            (*function)(begin, std::min(begin + chunkSize, count), chunk);
+
+            finishedChunks.fetch_add(1, std::memory_order_release);
+        }
+    }
+} // namespace lumina
@@ -0,0 +1,177 @@
+﻿#include "bindless_materials.hpp"
+
+#include "vk_buffer_utils.hpp"
+#include "vk_descriptors.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace lumina
+{
+    void BindlessMaterials::Init(VkDevice device, VmaAllocator allocator)
+    {
+        DescriptorLayoutBuilder layoutBuilder;
+        layoutBuilder.AddBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        layoutBuilder.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        layoutBuilder.bindings[1].descriptorCount = MAX_TEXTURES;
+
+        // Only the texture array is written while the set is in use, unused entries may hold stale or no descriptors at all.
+        const VkDescriptorBindingFlags bindingFlags[] = {0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT};
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo {};
+        bindingFlagsInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount  = 2;
+        bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+        layout = layoutBuilder.Build(
+            device,
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            &bindingFlagsInfo,
+            VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+        const VkDescriptorPoolSize poolSizes[] = {
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_TEXTURES}};
+
+        VkDescriptorPoolCreateInfo poolInfo {};
+        poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.maxSets       = 1;
+        poolInfo.poolSizeCount = 2;
+        poolInfo.pPoolSizes    = poolSizes;
+        VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool));
+
+        VkDescriptorSetAllocateInfo allocateInfo {};
+        allocateInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocateInfo.descriptorPool     = pool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts        = &layout;
+        VK_CHECK(vkAllocateDescriptorSets(device, &allocateInfo, &set));
+
+        materialBuffer = CreateBuffer(
+            allocator,
+            MAX_MATERIALS * sizeof(GPUMaterialData),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU,
+            MemoryCategory::Materials);
+
+        DescriptorWriter writer;
+        writer.WriteBuffer(0, materialBuffer.buffer, MAX_MATERIALS * sizeof(GPUMaterialData), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.UpdateSet(device, set);
+    }
+
+    void BindlessMaterials::Cleanup(VkDevice device, VmaAllocator allocator)
+    {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, layout, nullptr);
+        DestroyBuffer(allocator, materialBuffer);
+
+        materials.clear();
+        freeMaterials.clear();
+        textureSlots.clear();
+        textures.clear();
+        textureReferences.clear();
+        freeTextures.clear();
+    }
+
+    uint32_t BindlessMaterials::AddMaterial(
+        VkDevice device,
+        GPUMaterialData data,
+        VkImageView colorImage,
+        VkSampler colorSampler,
+        VkImageView metallicRoughnessImage,
+        VkSampler metallicRoughnessSampler)
+    {
+        uint32_t materialIndex;
+        if (!freeMaterials.empty())
+        {
+            materialIndex = freeMaterials.back();
+            freeMaterials.pop_back();
+        }
+        else
+        {
+            if (materials.size() == MAX_MATERIALS)
+            {
+                Log::Error("Bindless material table is full");
+                abort();
+            }
+            materialIndex = static_cast<uint32_t>(materials.size());
+            materials.emplace_back();
+        }
+
+        data.colorTexture             = AcquireTexture(device, colorImage, colorSampler);
+        data.metallicRoughnessTexture = AcquireTexture(device, metallicRoughnessImage, metallicRoughnessSampler);
+
+        materials[materialIndex] = data;
+        memcpy(static_cast<GPUMaterialData*>(materialBuffer.allocationInfo.pMappedData) + materialIndex, &data, sizeof(GPUMaterialData));
+
+        return materialIndex;
+    }
+
+    void BindlessMaterials::RemoveMaterial(uint32_t materialIndex)
+    {
+        ReleaseTexture(materials[materialIndex].colorTexture);
+        ReleaseTexture(materials[materialIndex].metallicRoughnessTexture);
+        freeMaterials.push_back(materialIndex);
+    }
+
+    uint32_t BindlessMaterials::AcquireTexture(VkDevice device, VkImageView imageView, VkSampler sampler)
+    {
+        const TextureKey key {imageView, sampler};
+
+        auto it = textureSlots.find(key);
+        if (it != textureSlots.end())
+        {
+            textureReferences[it->second]++;
+            return it->second;
+        }
+
+        uint32_t textureIndex;
+        if (!freeTextures.empty())
+        {
+            textureIndex = freeTextures.back();
+            freeTextures.pop_back();
+        }
+        else
+        {
+            if (textures.size() == MAX_TEXTURES)
+            {
+                Log::Error("Bindless texture table is full");
+                abort();
+            }
+            textureIndex = static_cast<uint32_t>(textures.size());
+            textures.emplace_back();
+            textureReferences.emplace_back();
+        }
+
+        textures[textureIndex]          = key;
+        textureReferences[textureIndex] = 1;
+        textureSlots[key]               = textureIndex;
+
+        VkDescriptorImageInfo imageInfo {};
+        imageInfo.sampler     = sampler;
+        imageInfo.imageView   = imageView;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write {};
+        write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet          = set;
+        write.dstBinding      = 1;
+        write.dstArrayElement = textureIndex;
+        write.descriptorCount = 1;
+        write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo      = &imageInfo;
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+        return textureIndex;
+    }
+
+    void BindlessMaterials::ReleaseTexture(uint32_t textureIndex)
+    {
+        if (--textureReferences[textureIndex] == 0)
+        {
+            textureSlots.erase(textures[textureIndex]);
+            freeTextures.push_back(textureIndex);
+        }
+    }
+} // namespace lumina
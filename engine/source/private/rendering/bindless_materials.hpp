@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include "vk_types.hpp"
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace lumina
+{
+    // Matches MaterialData in input_structures.glsl.
+    struct GPUMaterialData
+    {
+        float4 colorFactors;
+        float4 metallicRoughnessFactors;
+        uint32_t colorTexture;
+        uint32_t metallicRoughnessTexture;
+        uint32_t padding[2];
+    };
+
+    /**
+     * Every material and texture of the renderer in a single descriptor set.
+     * Material constants live in one storage buffer indexed by the material index of a draw, textures in one update after bind
+     * array indexed by the texture indices of the material. The set is bound once per pipeline, so changing materials between
+     * draws only changes a push constant.
+     *
+     * Textures are shared between materials by image view and sampler, and their slot is reused once no material refers to it.
+     */
+    class BindlessMaterials
+    {
+    public:
+        static constexpr uint32_t MAX_MATERIALS = 16384;
+        static constexpr uint32_t MAX_TEXTURES  = 16384;
+
+        void Init(VkDevice device, VmaAllocator allocator);
+        void Cleanup(VkDevice device, VmaAllocator allocator);
+
+        // The texture indices of data are filled in from the given images.
+        uint32_t AddMaterial(
+            VkDevice device,
+            GPUMaterialData data,
+            VkImageView colorImage,
+            VkSampler colorSampler,
+            VkImageView metallicRoughnessImage,
+            VkSampler metallicRoughnessSampler);
+
+        // The slot can be reused right away, so the caller has to make sure the GPU no longer draws with the material.
+        void RemoveMaterial(uint32_t materialIndex);
+
+        [[nodiscard]] VkDescriptorSetLayout Layout() const
+        {
+            return layout;
+        }
+
+        [[nodiscard]] VkDescriptorSet Set() const
+        {
+            return set;
+        }
+
+    private:
+        struct TextureKey
+        {
+            VkImageView imageView;
+            VkSampler sampler;
+
+            bool operator==(const TextureKey& other) const
+            {
+                return imageView == other.imageView && sampler == other.sampler;
+            }
+        };
+
+        struct TextureKeyHash
+        {
+            size_t operator()(const TextureKey& key) const
+            {
+                return std::hash<const void*>()(key.imageView) ^ std::hash<const void*>()(key.sampler) << 1;
+            }
+        };
+
+        uint32_t AcquireTexture(VkDevice device, VkImageView imageView, VkSampler sampler);
+        void ReleaseTexture(uint32_t textureIndex);
+
+        VkDescriptorSetLayout layout {VK_NULL_HANDLE};
+        VkDescriptorPool pool {VK_NULL_HANDLE};
+        VkDescriptorSet set {VK_NULL_HANDLE};
+
+        AllocatedBuffer materialBuffer {};
+        std::vector<GPUMaterialData> materials;
+        std::vector<uint32_t> freeMaterials;
+
+        std::unordered_map<TextureKey, uint32_t, TextureKeyHash> textureSlots;
+        std::vector<TextureKey> textures;
+        std::vector<uint32_t> textureReferences;
+        std::vector<uint32_t> freeTextures;
+    };
+} // namespace lumina
@@ -0,0 +1,260 @@
+﻿#include "bounding_volume_hierarchy.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <numeric>
+
+namespace lumina
+{
+    namespace
+    {
+        constexpr uint32_t ALL_PLANES = 0x3f;
+
+        // Returns false when the box is outside one of the planes, outIntersecting gets the planes the box crosses.
+        bool ClassifyBox(const Frustum& frustum, uint32_t planeMask, const float3& center, const float3& extent, uint32_t& outIntersecting)
+        {
+            outIntersecting = 0;
+            for (uint32_t p = 0; p < 6; p++)
+            {
+                if ((planeMask & (1u << p)) == 0)
+                {
+                    continue;
+                }
+
+                const float4& plane  = frustum.planes[p];
+                const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+                const float radius   = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+
+                if (distance + radius < 0.0f)
+                {
+                    return false;
+                }
+                if (distance - radius < 0.0f)
+                {
+                    outIntersecting |= 1u << p;
+                }
+            }
+            return true;
+        }
+    } // namespace
+
+    void BoundingVolumeHierarchy::Build(const CullingBounds& bounds)
+    {
+        const auto count = static_cast<uint32_t>(bounds.Size());
+
+        nodes.clear();
+        items.resize(count);
+        std::iota(items.begin(), items.end(), 0);
+
+        if (count == 0)
+        {
+            return;
+        }
+
+        nodes.reserve(2 * (count / MAX_LEAF_SIZE + 1));
+        nodes.push_back(Node {float3 {0.0f}, 0, float3 {0.0f}, 0, count});
+        Subdivide(0, bounds);
+
+        GatherItemBounds(bounds);
+    }
+
+    void BoundingVolumeHierarchy::Refit(const CullingBounds& bounds)
+    {
+        if (bounds.Size() != items.size())
+        {
+            Build(bounds);
+            return;
+        }
+
+        GatherItemBounds(bounds);
+
+        // Children are always stored after their parent, so a reverse pass visits them first.
+        for (size_t i = nodes.size(); i > 0; i--)
+        {
+            Node& node = nodes[i - 1];
+            if (node.leftChild == 0)
+            {
+                FitLeaf(node, bounds);
+            }
+            else
+            {
+                const Node& left  = nodes[node.leftChild];
+                const Node& right = nodes[node.leftChild + 1];
+                node.min          = glm::min(left.min, right.min);
+                node.max          = glm::max(left.max, right.max);
+            }
+        }
+    }
+
+    void BoundingVolumeHierarchy::Clear()
+    {
+        nodes.clear();
+        items.clear();
+        itemBounds.Clear();
+    }
+
+    uint32_t BoundingVolumeHierarchy::Cull(const Frustum& frustum, uint32_t node, uint32_t* outIndices) const
+    {
+        if (nodes.empty())
+        {
+            return 0;
+        }
+
+        struct StackEntry
+        {
+            uint32_t node;
+            uint32_t planeMask;
+        };
+
+        // Median splits keep the depth logarithmic, 64 levels is far beyond anything that fits in memory.
+        std::array<StackEntry, 64> stack;
+        uint32_t stackSize    = 0;
+        stack[stackSize++]    = {node, ALL_PLANES};
+        uint32_t visibleCount = 0;
+
+        while (stackSize > 0)
+        {
+            const StackEntry entry = stack[--stackSize];
+            const Node& current    = nodes[entry.node];
+
+            uint32_t intersecting;
+            if (!ClassifyBox(frustum, entry.planeMask, (current.min + current.max) * 0.5f, (current.max - current.min) * 0.5f, intersecting))
+            {
+                continue;
+            }
+
+            // Fully inside, nothing below this node needs testing anymore.
+            if (intersecting == 0)
+            {
+                std::copy_n(items.begin() + current.itemBegin, current.itemCount, outIndices + visibleCount);
+                visibleCount += current.itemCount;
+                continue;
+            }
+
+            // Leaf objects are stored in item order, so the batched test can run over them directly.
+            if (current.leftChild == 0)
+            {
+                uint32_t* leafOutput = outIndices + visibleCount;
+                const uint32_t count = CullAABBs(frustum, itemBounds, current.itemBegin, current.itemBegin + current.itemCount, leafOutput);
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    leafOutput[i] = items[leafOutput[i]];
+                }
+                visibleCount += count;
+                continue;
+            }
+
+            // Right first so the left subtree is visited first and the output stays in item order.
+            stack[stackSize++] = {current.leftChild + 1, intersecting};
+            stack[stackSize++] = {current.leftChild, intersecting};
+        }
+
+        return visibleCount;
+    }
+
+    void BoundingVolumeHierarchy::CollectSubtrees(uint32_t maxItems, std::vector<uint32_t>& outNodes) const
+    {
+        outNodes.clear();
+        if (nodes.empty())
+        {
+            return;
+        }
+
+        std::vector<uint32_t> stack {0};
+        while (!stack.empty())
+        {
+            const uint32_t nodeIndex = stack.back();
+            stack.pop_back();
+
+            const Node& node = nodes[nodeIndex];
+            if (node.itemCount <= maxItems || node.leftChild == 0)
+            {
+                outNodes.push_back(nodeIndex);
+            }
+            else
+            {
+                stack.push_back(node.leftChild + 1);
+                stack.push_back(node.leftChild);
+            }
+        }
+    }
+
+    void BoundingVolumeHierarchy::Subdivide(uint32_t nodeIndex, const CullingBounds& bounds)
+    {
+        FitLeaf(nodes[nodeIndex], bounds);
+
+        const uint32_t begin = nodes[nodeIndex].itemBegin;
+        const uint32_t count = nodes[nodeIndex].itemCount;
+        if (count <= MAX_LEAF_SIZE)
+        {
+            return;
+        }
+
+        const std::array<const float*, 3> centers {bounds.centerX.data(), bounds.centerY.data(), bounds.centerZ.data()};
+
+        // Split along the axis where the object centers are spread out the most.
+        auto centerMin = float3 {FLT_MAX};
+        auto centerMax = float3 {-FLT_MAX};
+        for (uint32_t i = begin; i < begin + count; i++)
+        {
+            const float3 center {centers[0][items[i]], centers[1][items[i]], centers[2][items[i]]};
+            centerMin = glm::min(centerMin, center);
+            centerMax = glm::max(centerMax, center);
+        }
+
+        const float3 spread = centerMax - centerMin;
+        const int axis      = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+        if (spread[axis] <= 0.0f)
+        {
+            return;
+        }
+
+        const uint32_t leftCount = count / 2;
+        const float* axisCenters = centers[axis];
+        std::nth_element(
+            items.begin() + begin,
+            items.begin() + begin + leftCount,
+            items.begin() + begin + count,
+            [axisCenters](uint32_t a, uint32_t b) { return axisCenters[a] < axisCenters[b]; });
+
+        const auto leftChild       = static_cast<uint32_t>(nodes.size());
+        nodes[nodeIndex].leftChild = leftChild;
+        nodes.push_back(Node {float3 {0.0f}, 0, float3 {0.0f}, begin, leftCount});
+        nodes.push_back(Node {float3 {0.0f}, 0, float3 {0.0f}, begin + leftCount, count - leftCount});
+
+        Subdivide(leftChild, bounds);
+        Subdivide(leftChild + 1, bounds);
+    }
+
+    void BoundingVolumeHierarchy::GatherItemBounds(const CullingBounds& bounds)
+    {
+        itemBounds.Resize(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+        {
+            const uint32_t item   = items[i];
+            itemBounds.centerX[i] = bounds.centerX[item];
+            itemBounds.centerY[i] = bounds.centerY[item];
+            itemBounds.centerZ[i] = bounds.centerZ[item];
+            itemBounds.extentX[i] = bounds.extentX[item];
+            itemBounds.extentY[i] = bounds.extentY[item];
+            itemBounds.extentZ[i] = bounds.extentZ[item];
+            itemBounds.radius[i]  = bounds.radius[item];
+        }
+    }
+
+    void BoundingVolumeHierarchy::FitLeaf(Node& node, const CullingBounds& bounds) const
+    {
+        node.min = float3 {FLT_MAX};
+        node.max = float3 {-FLT_MAX};
+        for (uint32_t i = node.itemBegin; i < node.itemBegin + node.itemCount; i++)
+        {
+            const uint32_t item = items[i];
+            const float3 center {bounds.centerX[item], bounds.centerY[item], bounds.centerZ[item]};
+            const float3 extent {bounds.extentX[item], bounds.extentY[item], bounds.extentZ[item]};
+
+            node.min = glm::min(node.min, center - extent);
+            node.max = glm::max(node.max, center + extent);
+        }
+    }
+} // namespace lumina
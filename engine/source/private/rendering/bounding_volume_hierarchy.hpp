@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include "culling.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace lumina
+{
+    /**
+     * Bounding volume hierarchy over the world space boxes of a CullingBounds list.
+     * Nodes are stored depth first with both children next to each other, and every subtree covers one contiguous range of items.
+     * A subtree fully inside the frustum emits its whole range without testing any of the objects below it.
+     *
+     * Build sorts the objects into the tree, which is only needed when objects are added or removed.
+     * When only transforms change, Refit recomputes the node boxes bottom up and keeps the tree layout.
+     */
+    class BoundingVolumeHierarchy
+    {
+    public:
+        static constexpr uint32_t MAX_LEAF_SIZE = 16;
+
+        void Build(const CullingBounds& bounds);
+        void Refit(const CullingBounds& bounds);
+        void Clear();
+
+        // Writes the indices of every object inside the frustum below node to outIndices, which needs room for ItemCount(node) entries.
+        uint32_t Cull(const Frustum& frustum, uint32_t node, uint32_t* outIndices) const;
+
+        // Splits the tree into subtrees of at most maxItems objects, in item order, so they can be culled in parallel.
+        void CollectSubtrees(uint32_t maxItems, std::vector<uint32_t>& outNodes) const;
+
+        [[nodiscard]] uint32_t ItemBegin(uint32_t node) const
+        {
+            return nodes[node].itemBegin;
+        }
+
+        [[nodiscard]] uint32_t ItemCount(uint32_t node) const
+        {
+            return nodes[node].itemCount;
+        }
+
+        [[nodiscard]] bool Empty() const
+        {
+            return nodes.empty();
+        }
+
+    private:
+        struct Node
+        {
+            float3 min;
+            uint32_t leftChild; // 0 for leaves, the root is never a child so it can't collide. The right child is leftChild + 1.
+            float3 max;
+            uint32_t itemBegin;
+            uint32_t itemCount;
+        };
+
+        void Subdivide(uint32_t nodeIndex, const CullingBounds& bounds);
+        void FitLeaf(Node& node, const CullingBounds& bounds) const;
+        void GatherItemBounds(const CullingBounds& bounds);
+
+        std::vector<Node> nodes;
+        std::vector<uint32_t> items;
+
+        // Copy of the object bounds in item order, so leaves can be tested with the batched frustum test.
+        CullingBounds itemBounds;
+    };
+} // namespace lumina
@@ -0,0 +1,481 @@
+﻿#include "culling.hpp"
+
+#include "core/log.hpp"
+#include "core/simd.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <random>
+
+namespace lumina
+{
+    namespace
+    {
+        bool IsBackendSupported(CullingBackend backend)
+        {
+            switch (backend)
+            {
+                case CullingBackend::Scalar: return true;
+#if defined(LUMINA_SIMD_SSE)
+                case CullingBackend::SSE:  return true;
+                case CullingBackend::AVX2: return simd::HasAVX2();
+#endif
+                default: return false;
+            }
+        }
+
+        template <bool TestBoxes>
+        uint32_t CullScalar(const Frustum& frustum, const CullingBounds& bounds, uint32_t begin, uint32_t end, uint32_t* outIndices)
+        {
+            uint32_t count = 0;
+            for (uint32_t i = begin; i < end; i++)
+            {
+                bool visible = true;
+                for (const float4& plane : frustum.planes)
+                {
+                    const float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+
+                    float radius;
+                    if constexpr (TestBoxes)
+                    {
+                        radius = std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+                    }
+                    else
+                    {
+                        radius = bounds.radius[i];
+                    }
+
+                    if (distance + radius < 0.0f)
+                    {
+                        visible = false;
+                        break;
+                    }
+                }
+
+                // Always write, only advance for visible objects, this keeps the loop free of unpredictable branches.
+                outIndices[count] = i;
+                count += visible ? 1 : 0;
+            }
+            return count;
+        }
+
+#if defined(LUMINA_SIMD_SSE)
+        template <bool TestBoxes>
+        uint32_t CullSSE(const Frustum& frustum, const CullingBounds& bounds, uint32_t begin, uint32_t end, uint32_t* outIndices)
+        {
+            const __m128 zero    = _mm_setzero_ps();
+            const __m128 allOnes = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+            __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+            __m128 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+            for (int p = 0; p < 6; p++)
+            {
+                planeX[p]    = _mm_set1_ps(frustum.planes[p].x);
+                planeY[p]    = _mm_set1_ps(frustum.planes[p].y);
+                planeZ[p]    = _mm_set1_ps(frustum.planes[p].z);
+                planeW[p]    = _mm_set1_ps(frustum.planes[p].w);
+                absPlaneX[p] = _mm_and_ps(planeX[p], absMask);
+                absPlaneY[p] = _mm_and_ps(planeY[p], absMask);
+                absPlaneZ[p] = _mm_and_ps(planeZ[p], absMask);
+            }
+
+            uint32_t count = 0;
+            uint32_t i     = begin;
+            for (; i + 4 <= end; i += 4)
+            {
+                const __m128 centerX = _mm_loadu_ps(bounds.centerX.data() + i);
+                const __m128 centerY = _mm_loadu_ps(bounds.centerY.data() + i);
+                const __m128 centerZ = _mm_loadu_ps(bounds.centerZ.data() + i);
+
+                __m128 extentX = zero, extentY = zero, extentZ = zero, radius = zero;
+                if constexpr (TestBoxes)
+                {
+                    extentX = _mm_loadu_ps(bounds.extentX.data() + i);
+                    extentY = _mm_loadu_ps(bounds.extentY.data() + i);
+                    extentZ = _mm_loadu_ps(bounds.extentZ.data() + i);
+                }
+                else
+                {
+                    radius = _mm_loadu_ps(bounds.radius.data() + i);
+                }
+
+                __m128 inside = allOnes;
+                for (int p = 0; p < 6; p++)
+                {
+                    const __m128 distance = _mm_add_ps(
+                        _mm_add_ps(_mm_mul_ps(planeX[p], centerX), _mm_mul_ps(planeY[p], centerY)),
+                        _mm_add_ps(_mm_mul_ps(planeZ[p], centerZ), planeW[p]));
+
+                    __m128 planeRadius = radius;
+                    if constexpr (TestBoxes)
+                    {
+                        planeRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absPlaneX[p], extentX), _mm_mul_ps(absPlaneY[p], extentY)), _mm_mul_ps(absPlaneZ[p], extentZ));
+                    }
+
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, planeRadius), zero));
+                }
+
+                const int mask = _mm_movemask_ps(inside);
+                for (uint32_t lane = 0; lane < 4; lane++)
+                {
+                    outIndices[count] = i + lane;
+                    count += (mask >> lane) & 1;
+                }
+            }
+
+            return count + CullScalar<TestBoxes>(frustum, bounds, i, end, outIndices + count);
+        }
+
+        template <bool TestBoxes>
+        LUMINA_TARGET_AVX2 uint32_t CullAVX2(const Frustum& frustum, const CullingBounds& bounds, uint32_t begin, uint32_t end, uint32_t* outIndices)
+        {
+            const __m256 zero    = _mm256_setzero_ps();
+            const __m256 allOnes = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+            __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+            __m256 absPlaneX[6], absPlaneY[6], absPlaneZ[6];
+            for (int p = 0; p < 6; p++)
+            {
+                planeX[p]    = _mm256_set1_ps(frustum.planes[p].x);
+                planeY[p]    = _mm256_set1_ps(frustum.planes[p].y);
+                planeZ[p]    = _mm256_set1_ps(frustum.planes[p].z);
+                planeW[p]    = _mm256_set1_ps(frustum.planes[p].w);
+                absPlaneX[p] = _mm256_and_ps(planeX[p], absMask);
+                absPlaneY[p] = _mm256_and_ps(planeY[p], absMask);
+                absPlaneZ[p] = _mm256_and_ps(planeZ[p], absMask);
+            }
+
+            uint32_t count = 0;
+            uint32_t i     = begin;
+            for (; i + 8 <= end; i += 8)
+            {
+                const __m256 centerX = _mm256_loadu_ps(bounds.centerX.data() + i);
+                const __m256 centerY = _mm256_loadu_ps(bounds.centerY.data() + i);
+                const __m256 centerZ = _mm256_loadu_ps(bounds.centerZ.data() + i);
+
+                __m256 extentX = zero, extentY = zero, extentZ = zero, radius = zero;
+                if constexpr (TestBoxes)
+                {
+                    extentX = _mm256_loadu_ps(bounds.extentX.data() + i);
+                    extentY = _mm256_loadu_ps(bounds.extentY.data() + i);
+                    extentZ = _mm256_loadu_ps(bounds.extentZ.data() + i);
+                }
+                else
+                {
+                    radius = _mm256_loadu_ps(bounds.radius.data() + i);
+                }
+
+                __m256 inside = allOnes;
+                for (int p = 0; p < 6; p++)
+                {
+                    const __m256 distance = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(planeX[p], centerX), _mm256_mul_ps(planeY[p], centerY)),
+                        _mm256_add_ps(_mm256_mul_ps(planeZ[p], centerZ), planeW[p]));
+
+                    __m256 planeRadius = radius;
+                    if constexpr (TestBoxes)
+                    {
+                        planeRadius = _mm256_add_ps(
+                            _mm256_add_ps(_mm256_mul_ps(absPlaneX[p], extentX), _mm256_mul_ps(absPlaneY[p], extentY)),
+                            _mm256_mul_ps(absPlaneZ[p], extentZ));
+                    }
+
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, planeRadius), zero, _CMP_GE_OQ));
+                }
+
+                const int mask = _mm256_movemask_ps(inside);
+                for (uint32_t lane = 0; lane < 8; lane++)
+                {
+                    outIndices[count] = i + lane;
+                    count += (mask >> lane) & 1;
+                }
+            }
+
+            return count + CullScalar<TestBoxes>(frustum, bounds, i, end, outIndices + count);
+        }
+#endif
+
+        template <bool TestBoxes>
+        uint32_t Cull(const Frustum& frustum, const CullingBounds& bounds, uint32_t begin, uint32_t end, uint32_t* outIndices, CullingBackend backend)
+        {
+            if (!IsBackendSupported(backend))
+            {
+                backend = BestCullingBackend();
+            }
+
+            switch (backend)
+            {
+#if defined(LUMINA_SIMD_SSE)
+                case CullingBackend::AVX2: return CullAVX2<TestBoxes>(frustum, bounds, begin, end, outIndices);
+                case CullingBackend::SSE:  return CullSSE<TestBoxes>(frustum, bounds, begin, end, outIndices);
+#endif
+                default: return CullScalar<TestBoxes>(frustum, bounds, begin, end, outIndices);
+            }
+        }
+    } // namespace
+
+    Frustum Frustum::FromMatrix(const glm::mat4& viewProjection)
+    {
+        const float4 row0 {viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]};
+        const float4 row1 {viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]};
+        const float4 row2 {viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]};
+        const float4 row3 {viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]};
+
+        // Clip space is -w <= x, y <= w and 0 <= z <= w, which holds for the reversed depth range as well.
+        Frustum frustum {};
+        frustum.planes = {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2};
+
+        for (float4& plane : frustum.planes)
+        {
+            plane /= glm::length(float3(plane));
+        }
+        return frustum;
+    }
+
+    void CullingBounds::Set(size_t index, const Bounds& localBounds, const AffineTransform& transform)
+    {
+        const float3 center = transform.TransformPoint(localBounds.origin);
+
+        const auto axisX = transform.Axis(0);
+        const auto axisY = transform.Axis(1);
+        const auto axisZ = transform.Axis(2);
+
+        const float3 extents = glm::abs(axisX) * localBounds.extents.x + glm::abs(axisY) * localBounds.extents.y + glm::abs(axisZ) * localBounds.extents.z;
+        const float maxScale = std::max({glm::length(axisX), glm::length(axisY), glm::length(axisZ)});
+
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        extentX[index] = extents.x;
+        extentY[index] = extents.y;
+        extentZ[index] = extents.z;
+        radius[index]  = localBounds.sphereRadius * maxScale;
+    }
+
+    void CullingBounds::PushBack(const Bounds& localBounds, const AffineTransform& transform)
+    {
+        Resize(Size() + 1);
+        Set(Size() - 1, localBounds, transform);
+    }
+
+    void CullingBounds::Copy(size_t destination, size_t source)
+    {
+        centerX[destination] = centerX[source];
+        centerY[destination] = centerY[source];
+        centerZ[destination] = centerZ[source];
+        extentX[destination] = extentX[source];
+        extentY[destination] = extentY[source];
+        extentZ[destination] = extentZ[source];
+        radius[destination]  = radius[source];
+    }
+
+    void CullingBounds::PopBack()
+    {
+        Resize(Size() - 1);
+    }
+
+    void CullingBounds::Resize(size_t count)
+    {
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        extentX.resize(count);
+        extentY.resize(count);
+        extentZ.resize(count);
+        radius.resize(count);
+    }
+
+    void CullingBounds::Clear()
+    {
+        Resize(0);
+    }
+
+    uint32_t CullByContribution(
+        const CullingBounds& bounds,
+        const float3& cameraPosition,
+        float pixelScale,
+        float minPixels,
+        uint32_t* indices,
+        uint32_t count)
+    {
+        // pi * (radius * pixelScale / distance)^2 >= minPixels, rearranged to avoid a square root and division per object.
+        const float threshold = minPixels / (glm::pi<float>() * pixelScale * pixelScale);
+
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const uint32_t index = indices[i];
+            const float dx       = bounds.centerX[index] - cameraPosition.x;
+            const float dy       = bounds.centerY[index] - cameraPosition.y;
+            const float dz       = bounds.centerZ[index] - cameraPosition.z;
+            const float radius   = bounds.radius[index];
+
+            indices[kept] = index;
+            kept += radius * radius >= threshold * (dx * dx + dy * dy + dz * dz) ? 1 : 0;
+        }
+        return kept;
+    }
+
+    CullingBackend BestCullingBackend()
+    {
+        if (IsBackendSupported(CullingBackend::AVX2))
+        {
+            return CullingBackend::AVX2;
+        }
+        if (IsBackendSupported(CullingBackend::SSE))
+        {
+            return CullingBackend::SSE;
+        }
+        return CullingBackend::Scalar;
+    }
+
+    const char* CullingBackendName(CullingBackend backend)
+    {
+        switch (backend)
+        {
+            case CullingBackend::Scalar: return "Scalar";
+            case CullingBackend::SSE:    return "SSE";
+            case CullingBackend::AVX2:   return "AVX2";
+            default:                     return "Unknown";
+        }
+    }
+
+    uint32_t CullSpheres(const Frustum& frustum, const CullingBounds& bounds, uint32_t begin, uint32_t end, uint32_t* outIndices, CullingBackend backend)
+    {
+        return Cull<false>(frustum, bounds, begin, end, outIndices, backend);
+    }
+
+    uint32_t CullAABBs(const Frustum& frustum, const CullingBounds& bounds, uint32_t begin, uint32_t end, uint32_t* outIndices, CullingBackend backend)
+    {
+        return Cull<true>(frustum, bounds, begin, end, outIndices, backend);
+    }
+
+    bool IsVisible(const RenderObject& object, const glm::mat4& viewProjection)
+    {
+        std::array<glm::vec3, 8> corners {
+            glm::vec3 {1, 1, 1},
+            glm::vec3 {1, 1, -1},
+            glm::vec3 {1, -1, 1},
+            glm::vec3 {1, -1, -1},
+            glm::vec3 {-1, 1, 1},
+            glm::vec3 {-1, 1, -1},
+            glm::vec3 {-1, -1, 1},
+            glm::vec3 {-1, -1, -1},
+        };
+
+        glm::mat4 matrix = viewProjection * object.transform.ToMatrix();
+
+        auto min = float3 {1.5f, 1.5f, 1.5f};
+        auto max = float3 {-1.5f, -1.5f, -1.5f};
+
+        for (int c = 0; c < 8; c++)
+        {
+            float4 v = matrix * float4(object.bounds.origin + (corners[c] * object.bounds.extents), 1.0f);
+
+            v.x = v.x / v.w;
+            v.y = v.y / v.w;
+            v.z = v.z / v.w;
+
+            min = glm::min(float3 {v.x, v.y, v.z}, min);
+            max = glm::max(float3 {v.x, v.y, v.z}, max);
+        }
+        if (min.z > 1.0f || max.z < 0.0f || min.x > 1.0f || max.x < -1.0f || min.y > 1.0f || max.y < -1.0f)
+        {
+            return false;
+        }
+        else
+        {
+            return true;
+        }
+    }
+
+    void RunCullingBenchmark()
+    {
+        glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 10000.0f, 0.1f);
+        projection[1][1] *= -1;
+
+        const glm::mat4 viewProjection = projection * glm::lookAt(float3 {0.0f}, float3 {0.0f, 0.0f, -1.0f}, float3 {0.0f, 1.0f, 0.0f});
+        const Frustum frustum          = Frustum::FromMatrix(viewProjection);
+
+        std::mt19937 random {1337};
+        std::uniform_real_distribution<float> position {-1000.0f, 1000.0f};
+        std::uniform_real_distribution<float> size {0.5f, 5.0f};
+
+        for (const uint32_t count : {10000u, 100000u, 1000000u})
+        {
+            std::vector<RenderObject> objects(count);
+            CullingBounds bounds;
+            for (auto& object : objects)
+            {
+                object.bounds.origin       = float3 {0.0f};
+                object.bounds.extents      = float3 {size(random), size(random), size(random)};
+                object.bounds.sphereRadius = glm::length(object.bounds.extents);
+                object.transform           = AffineTransform::FromTranslation(float3 {position(random), position(random), position(random)});
+
+                bounds.PushBack(object.bounds, object.transform);
+            }
+
+            std::vector<uint32_t> visible(count);
+            uint32_t visibleCount {};
+
+            // Best of a few runs, the first one mostly measures cache misses.
+            const auto measure = [&](auto&& cull) {
+                float best = FLT_MAX;
+                for (int run = 0; run < 5; run++)
+                {
+                    const auto start = std::chrono::high_resolution_clock::now();
+                    visibleCount     = cull();
+                    const auto end   = std::chrono::high_resolution_clock::now();
+                    best             = std::min(best, std::chrono::duration<float, std::milli>(end - start).count());
+                }
+                return best;
+            };
+
+            const float reference = measure([&] {
+                uint32_t visibleObjects = 0;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    if (IsVisible(objects[i], viewProjection))
+                    {
+                        visible[visibleObjects++] = i;
+                    }
+                }
+                return visibleObjects;
+            });
+            Log::Info("Culling benchmark, {} objects: IsVisible {:.3f} ms ({} visible)", count, reference, visibleCount);
+
+            for (const CullingBackend backend : {CullingBackend::Scalar, CullingBackend::SSE, CullingBackend::AVX2})
+            {
+                if (!IsBackendSupported(backend))
+                {
+                    continue;
+                }
+
+                const float spheres = measure([&] {
+                    return CullSpheres(frustum, bounds, 0, count, visible.data(), backend);
+                });
+                const uint32_t visibleSpheres = visibleCount;
+
+                const float boxes = measure([&] {
+                    return CullAABBs(frustum, bounds, 0, count, visible.data(), backend);
+                });
+
+                Log::Info(
+                    "    {}: spheres {:.3f} ms ({} visible, {:.1f}x), boxes {:.3f} ms ({} visible, {:.1f}x)",
+                    CullingBackendName(backend),
+                    spheres,
+                    visibleSpheres,
+                    reference / spheres,
+                    boxes,
+                    visibleCount,
+                    reference / boxes);
+            }
+        }
+    }
+} // namespace lumina
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    struct Frustum
+    {
+        // Normalized planes as (normal, distance), a point is inside when dot(normal, point) + distance >= 0 for all of them.
+        std::array<float4, 6> planes;
+
+        static Frustum FromMatrix(const glm::mat4& viewProjection);
+    };
+
+    /**
+     * World space bounds of cullable objects, stored as structure-of-arrays so several objects can be tested at once.
+     * Every object carries both an axis aligned box (center + extents) and a bounding sphere (center + radius).
+     */
+    struct CullingBounds
+    {
+        std::vector<float> centerX;
+        std::vector<float> centerY;
+        std::vector<float> centerZ;
+        std::vector<float> extentX;
+        std::vector<float> extentY;
+        std::vector<float> extentZ;
+        std::vector<float> radius;
+
+        void Set(size_t index, const Bounds& localBounds, const AffineTransform& transform);
+        void PushBack(const Bounds& localBounds, const AffineTransform& transform);
+        void Copy(size_t destination, size_t source);
+        void PopBack();
+        void Resize(size_t count);
+        void Clear();
+
+        [[nodiscard]] size_t Size() const
+        {
+            return centerX.size();
+        }
+    };
+
+    enum class CullingBackend : uint8_t
+    {
+        Scalar,
+        SSE,
+        AVX2,
+    };
+
+    CullingBackend BestCullingBackend();
+    const char* CullingBackendName(CullingBackend backend);
+
+    // Both write the indices of the visible objects in [begin, end) to outIndices, which needs room for (end - begin) entries.
+    // The returned value is the amount of visible objects written.
+    uint32_t CullSpheres(
+        const Frustum& frustum,
+        const CullingBounds& bounds,
+        uint32_t begin,
+        uint32_t end,
+        uint32_t* outIndices,
+        CullingBackend backend = BestCullingBackend());
+    uint32_t CullAABBs(
+        const Frustum& frustum,
+        const CullingBounds& bounds,
+        uint32_t begin,
+        uint32_t end,
+        uint32_t* outIndices,
+        CullingBackend backend = BestCullingBackend());
+
+    // Filters indices in place, keeping only objects whose projected bounding sphere covers at least minPixels pixels.
+    // pixelScale is the size in pixels of one world unit at a distance of one. Returns the amount of indices kept.
+    uint32_t CullByContribution(
+        const CullingBounds& bounds,
+        const float3& cameraPosition,
+        float pixelScale,
+        float minPixels,
+        uint32_t* indices,
+        uint32_t count);
+
+    // Reference test that projects all 8 corners of the object space box, kept for comparison with the batched paths.
+    bool IsVisible(const RenderObject& object, const glm::mat4& viewProjection);
+
+    // Times IsVisible against every culling backend at 10k, 100k and 1M random objects and logs the results.
+    void RunCullingBenchmark();
+} // namespace lumina
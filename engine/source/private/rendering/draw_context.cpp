@@ -0,0 +1,228 @@
+﻿#include "draw_context.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace lumina
+{
+    RenderObjectHandle DrawContext::Register(const RenderObject& object)
+    {
+        uint32_t slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            slot = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        }
+
+        Insert(slot, object);
+        version++;
+
+        return RenderObjectHandle {slot, slots[slot].generation};
+    }
+
+    void DrawContext::Unregister(RenderObjectHandle handle)
+    {
+        if (!IsValid(handle))
+        {
+            return;
+        }
+
+        Erase(handle.slot);
+
+        // Bumping the generation invalidates any handle still pointing at this slot.
+        slots[handle.slot].generation++;
+        freeSlots.push_back(handle.slot);
+        version++;
+    }
+
+    void DrawContext::SetTransform(RenderObjectHandle handle, const AffineTransform& transform)
+    {
+        assert(IsValid(handle));
+
+        const Slot& slot  = slots[handle.slot];
+        SurfaceList& list = ListFor(slot.transparent);
+
+        RenderObject& object = list.objects[slot.denseIndex];
+        object.transform     = transform;
+        list.bounds.Set(slot.denseIndex, object.bounds, transform);
+
+        if (!list.movedSinceBuildFlags[slot.denseIndex])
+        {
+            list.movedSinceBuildFlags[slot.denseIndex] = 1;
+            list.movedSinceBuild++;
+        }
+        if (list.hierarchyState == HierarchyState::UpToDate)
+        {
+            list.hierarchyState = HierarchyState::NeedsRefit;
+        }
+        version++;
+    }
+
+    void DrawContext::SetMaterial(RenderObjectHandle handle, MaterialInstance* material)
+    {
+        assert(IsValid(handle));
+
+        const Slot& slot              = slots[handle.slot];
+        const bool becomesTransparent = material->passType == MaterialPass::Transparent;
+        SurfaceList& list             = ListFor(slot.transparent);
+
+        list.objects[slot.denseIndex].material = material;
+        list.sortKeys[slot.denseIndex]         = MakeSortKey(list.objects[slot.denseIndex]);
+
+        // A pass change moves the surface to the other list, the handle itself stays the same.
+        if (becomesTransparent != slot.transparent)
+        {
+            const RenderObject object = list.objects[slot.denseIndex];
+            Erase(handle.slot);
+            Insert(handle.slot, object);
+        }
+        version++;
+    }
+
+    bool DrawContext::IsValid(RenderObjectHandle handle) const
+    {
+        return handle.slot < slots.size() && slots[handle.slot].generation == handle.generation && slots[handle.slot].denseIndex != UINT32_MAX;
+    }
+
+    const RenderObject& DrawContext::Get(RenderObjectHandle handle) const
+    {
+        assert(IsValid(handle));
+
+        const Slot& slot = slots[handle.slot];
+        return slot.transparent ? transparent.objects[slot.denseIndex] : opaque.objects[slot.denseIndex];
+    }
+
+    void DrawContext::Clear()
+    {
+        for (auto& slot : slots)
+        {
+            slot.generation++;
+            slot.denseIndex = UINT32_MAX;
+        }
+
+        freeSlots.clear();
+        for (uint32_t i = static_cast<uint32_t>(slots.size()); i > 0; i--)
+        {
+            freeSlots.push_back(i - 1);
+        }
+
+        opaque.objects.clear();
+        opaque.slots.clear();
+        opaque.sortKeys.clear();
+        opaque.movedSinceBuildFlags.clear();
+        opaque.bounds.Clear();
+        opaque.hierarchy.Clear();
+        opaque.hierarchyState = HierarchyState::NeedsRebuild;
+        transparent.objects.clear();
+        transparent.slots.clear();
+        transparent.sortKeys.clear();
+        transparent.movedSinceBuildFlags.clear();
+        transparent.bounds.Clear();
+        transparent.hierarchy.Clear();
+        transparent.hierarchyState = HierarchyState::NeedsRebuild;
+
+        pipelineIds.clear();
+        materialIds.clear();
+        indexBufferIds.clear();
+        geometryIds.clear();
+        version++;
+    }
+
+    const BoundingVolumeHierarchy& DrawContext::UpdateOpaqueHierarchy()
+    {
+        // Refitting keeps the tree layout, which gets loose once a large part of the objects moved far away from where they were built.
+        if (opaque.hierarchyState == HierarchyState::NeedsRefit && opaque.movedSinceBuild > opaque.bounds.Size() / 4)
+        {
+            opaque.hierarchyState = HierarchyState::NeedsRebuild;
+        }
+
+        if (opaque.hierarchyState == HierarchyState::NeedsRebuild)
+        {
+            opaque.hierarchy.Build(opaque.bounds);
+            std::fill(opaque.movedSinceBuildFlags.begin(), opaque.movedSinceBuildFlags.end(), uint8_t {0});
+            opaque.movedSinceBuild = 0;
+        }
+        else if (opaque.hierarchyState == HierarchyState::NeedsRefit)
+        {
+            opaque.hierarchy.Refit(opaque.bounds);
+        }
+
+        opaque.hierarchyState = HierarchyState::UpToDate;
+        return opaque.hierarchy;
+    }
+
+    DrawContext::SurfaceList& DrawContext::ListFor(bool transparentPass)
+    {
+        return transparentPass ? transparent : opaque;
+    }
+
+    void DrawContext::Insert(uint32_t slot, const RenderObject& object)
+    {
+        const bool isTransparent = object.material->passType == MaterialPass::Transparent;
+        SurfaceList& list        = ListFor(isTransparent);
+
+        slots[slot].transparent = isTransparent;
+        slots[slot].denseIndex  = static_cast<uint32_t>(list.objects.size());
+
+        list.objects.push_back(object);
+        list.slots.push_back(slot);
+        list.sortKeys.push_back(MakeSortKey(object));
+        list.movedSinceBuildFlags.push_back(0);
+        list.bounds.PushBack(object.bounds, object.transform);
+        list.hierarchyState = HierarchyState::NeedsRebuild;
+    }
+
+    void DrawContext::Erase(uint32_t slot)
+    {
+        SurfaceList& list    = ListFor(slots[slot].transparent);
+        const uint32_t index = slots[slot].denseIndex;
+        const uint32_t last  = static_cast<uint32_t>(list.objects.size()) - 1;
+
+        // Swap with the last surface to keep the list dense.
+        if (index != last)
+        {
+            list.objects[index]                 = list.objects[last];
+            list.slots[index]                   = list.slots[last];
+            list.sortKeys[index]                = list.sortKeys[last];
+            list.movedSinceBuildFlags[index]    = list.movedSinceBuildFlags[last];
+            slots[list.slots[index]].denseIndex = index;
+            list.bounds.Copy(index, last);
+        }
+
+        list.objects.pop_back();
+        list.slots.pop_back();
+        list.sortKeys.pop_back();
+        list.movedSinceBuildFlags.pop_back();
+        list.bounds.PopBack();
+        list.hierarchyState = HierarchyState::NeedsRebuild;
+        slots[slot].denseIndex = UINT32_MAX;
+    }
+
+    uint64_t DrawContext::MakeSortKey(const RenderObject& object)
+    {
+        const uint64_t pipeline    = SortId<const void*>(pipelineIds, object.material->pipeline, SORT_PIPELINE_BITS);
+        const uint64_t material    = SortId<const void*>(materialIds, object.material, SORT_MATERIAL_BITS);
+        const uint64_t indexBuffer = indexBufferIds.emplace(object.indexBuffer, static_cast<uint32_t>(indexBufferIds.size())).first->second;
+        const uint64_t indexType   = object.indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+
+        // The index type is the top bit of the geometry field, so meshes that need the same index buffer binding stay together.
+        const uint64_t geometryKey = (indexBuffer << 1 | indexType) << 32 | (object.indexOffset + object.firstIndex);
+        const uint64_t geometry    = indexType << (SORT_GEOMETRY_BITS - 1) | SortId<uint64_t>(geometryIds, geometryKey, SORT_GEOMETRY_BITS - 1);
+
+        return pipeline << (SORT_DEPTH_BITS + SORT_MATERIAL_BITS + SORT_GEOMETRY_BITS) | geometry << (SORT_DEPTH_BITS + SORT_MATERIAL_BITS)
+            | material << SORT_DEPTH_BITS;
+    }
+
+    template <typename Key>
+    uint32_t DrawContext::SortId(std::unordered_map<Key, uint32_t>& ids, const Key& key, uint32_t bits)
+    {
+        // Running out of ids only makes unrelated states share a key, which costs some state changes but draws the same.
+        const uint32_t id = ids.emplace(key, static_cast<uint32_t>(ids.size())).first->second;
+        return id & ((1u << bits) - 1);
+    }
+} // namespace lumina
@@ -0,0 +1,142 @@
+﻿#pragma once
+
+#include "bounding_volume_hierarchy.hpp"
+#include "culling.hpp"
+#include "vk_types.hpp"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace lumina
+{
+    struct RenderObjectHandle
+    {
+        uint32_t slot {UINT32_MAX};
+        uint32_t generation {0};
+    };
+
+    /**
+     * Retained registry of every surface that gets drawn.
+     * Surfaces are registered once and keep a stable handle, only transform or material changes touch the registry afterwards.
+     * The render objects themselves are kept densely packed per pass so the renderer can iterate them directly every frame.
+     */
+    class DrawContext
+    {
+    public:
+        // Layout of the sort keys, from the least to the most significant bits.
+        // The geometry is an index buffer and first index. Materials are bindless and only cost a push constant, so they rank below
+        // the geometry and merely keep copies of the same mesh with the same material next to each other.
+        static constexpr uint32_t SORT_DEPTH_BITS    = 16;
+        static constexpr uint32_t SORT_MATERIAL_BITS = 20;
+        static constexpr uint32_t SORT_GEOMETRY_BITS = 20;
+        static constexpr uint32_t SORT_PIPELINE_BITS = 8;
+
+        RenderObjectHandle Register(const RenderObject& object);
+        void Unregister(RenderObjectHandle handle);
+
+        void SetTransform(RenderObjectHandle handle, const AffineTransform& transform);
+        void SetMaterial(RenderObjectHandle handle, MaterialInstance* material);
+
+        [[nodiscard]] bool IsValid(RenderObjectHandle handle) const;
+        [[nodiscard]] const RenderObject& Get(RenderObjectHandle handle) const;
+
+        void Clear();
+
+        [[nodiscard]] const std::vector<RenderObject>& OpaqueSurfaces() const
+        {
+            return opaque.objects;
+        }
+
+        [[nodiscard]] const std::vector<RenderObject>& TransparentSurfaces() const
+        {
+            return transparent.objects;
+        }
+
+        // World space bounds of the opaque surfaces, index aligned with OpaqueSurfaces().
+        [[nodiscard]] const CullingBounds& OpaqueBounds() const
+        {
+            return opaque.bounds;
+        }
+
+        [[nodiscard]] const CullingBounds& TransparentBounds() const
+        {
+            return transparent.bounds;
+        }
+
+        // State part of the sort key of every opaque surface, index aligned with OpaqueSurfaces().
+        // Pipeline, material and index buffer ids are handed out in registration order, so the order is the same every run.
+        [[nodiscard]] const std::vector<uint64_t>& OpaqueSortKeys() const
+        {
+            return opaque.sortKeys;
+        }
+
+        // Depth part of a sort key. Positive floats order like their bit patterns, so the top bits of the squared distance
+        // give a logarithmic quantization without any math.
+        [[nodiscard]] static uint64_t DepthSortKey(float distanceSquared)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &distanceSquared, sizeof(bits));
+            return bits >> (32 - SORT_DEPTH_BITS);
+        }
+
+        // Rebuilds or refits the hierarchy over OpaqueBounds() if anything changed since the last call.
+        const BoundingVolumeHierarchy& UpdateOpaqueHierarchy();
+
+        // Incremented on every change to the registered surfaces, lets caches built from them detect when they are stale.
+        [[nodiscard]] uint64_t Version() const
+        {
+            return version;
+        }
+
+    private:
+        enum class HierarchyState : uint8_t
+        {
+            UpToDate,
+            NeedsRefit,
+            NeedsRebuild,
+        };
+
+        struct SurfaceList
+        {
+            std::vector<RenderObject> objects;
+            std::vector<uint32_t> slots;
+            std::vector<uint64_t> sortKeys;
+            CullingBounds bounds;
+
+            BoundingVolumeHierarchy hierarchy;
+            HierarchyState hierarchyState {HierarchyState::NeedsRebuild};
+            // Surfaces that moved since the hierarchy was built, each counted once however often it moves.
+            std::vector<uint8_t> movedSinceBuildFlags;
+            uint32_t movedSinceBuild {0};
+        };
+
+        struct Slot
+        {
+            uint32_t generation {0};
+            uint32_t denseIndex {UINT32_MAX};
+            bool transparent {false};
+        };
+
+        SurfaceList& ListFor(bool transparentPass);
+        void Insert(uint32_t slot, const RenderObject& object);
+        void Erase(uint32_t slot);
+
+        uint64_t MakeSortKey(const RenderObject& object);
+        template <typename Key>
+        static uint32_t SortId(std::unordered_map<Key, uint32_t>& ids, const Key& key, uint32_t bits);
+
+        std::vector<Slot> slots;
+        std::vector<uint32_t> freeSlots;
+
+        SurfaceList opaque;
+        SurfaceList transparent;
+
+        std::unordered_map<const void*, uint32_t> pipelineIds;
+        std::unordered_map<const void*, uint32_t> materialIds;
+        std::unordered_map<const void*, uint32_t> indexBufferIds;
+        std::unordered_map<uint64_t, uint32_t> geometryIds;
+
+        uint64_t version {0};
+    };
+} // namespace lumina
@@ -0,0 +1,109 @@
+﻿#include "geometry_pool.hpp"
+
+#include "vk_buffer_utils.hpp"
+
+#include <algorithm>
+
+namespace lumina
+{
+    void GeometryPool::Init(uint32_t stride)
+    {
+        vertexStride = stride;
+    }
+
+    void GeometryPool::Cleanup(VmaAllocator allocator)
+    {
+        for (Block& block : blocks)
+        {
+            DestroyBuffer(allocator, block.vertexBuffer);
+            DestroyBuffer(allocator, block.indexBuffer);
+        }
+        blocks.clear();
+    }
+
+    GeometryAllocation GeometryPool::Allocate(uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType, VkDevice device, VmaAllocator allocator)
+    {
+        GeometryAllocation allocation {};
+        allocation.vertexCount = vertexCount;
+        allocation.indexCount  = indexCount;
+        allocation.indexType   = indexType;
+
+        for (uint32_t i = 0; i < blocks.size(); i++)
+        {
+            if (AllocateFromBlock(i, allocation))
+            {
+                return allocation;
+            }
+        }
+
+        Block block {};
+        block.vertices = RangeAllocator(std::max(vertexCount, BLOCK_VERTEX_COUNT));
+        block.indices  = RangeAllocator(std::max(IndexUnits(indexCount, indexType), IndexUnits(BLOCK_INDEX_COUNT, VK_INDEX_TYPE_UINT32)));
+
+        block.vertexBuffer = CreateBuffer(
+            allocator,
+            static_cast<size_t>(block.vertices.Capacity()) * vertexStride,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY,
+            MemoryCategory::Geometry);
+        block.indexBuffer = CreateBuffer(
+            allocator,
+            static_cast<size_t>(block.indices.Capacity()) * sizeof(uint16_t),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY,
+            MemoryCategory::Geometry);
+
+        VkBufferDeviceAddressInfo addressInfo {};
+        addressInfo.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = block.vertexBuffer.buffer;
+
+        block.vertexBufferAddress = vkGetBufferDeviceAddress(device, &addressInfo);
+
+        blocks.push_back(std::move(block));
+        AllocateFromBlock(static_cast<uint32_t>(blocks.size()) - 1, allocation);
+
+        return allocation;
+    }
+
+    void GeometryPool::Free(const GeometryAllocation& allocation)
+    {
+        if (allocation.block >= blocks.size())
+        {
+            return;
+        }
+
+        Block& block = blocks[allocation.block];
+        block.vertices.Free(allocation.firstVertex, allocation.vertexCount);
+        const uint32_t unitsPerIndex = IndexSize(allocation.indexType) / sizeof(uint16_t);
+        block.indices.Free(allocation.firstIndex * unitsPerIndex, IndexUnits(allocation.indexCount, allocation.indexType));
+    }
+
+    uint32_t GeometryPool::IndexUnits(uint32_t indexCount, VkIndexType indexType)
+    {
+        const uint32_t units = indexCount * (IndexSize(indexType) / sizeof(uint16_t));
+        return (units + 1) & ~1u;
+    }
+
+    bool GeometryPool::AllocateFromBlock(uint32_t blockIndex, GeometryAllocation& allocation)
+    {
+        Block& block = blocks[blockIndex];
+
+        const uint32_t firstVertex = block.vertices.Allocate(allocation.vertexCount);
+        if (firstVertex == RangeAllocator::INVALID_OFFSET)
+        {
+            return false;
+        }
+
+        const uint32_t firstUnit = block.indices.Allocate(IndexUnits(allocation.indexCount, allocation.indexType));
+        if (firstUnit == RangeAllocator::INVALID_OFFSET)
+        {
+            block.vertices.Free(firstVertex, allocation.vertexCount);
+            return false;
+        }
+
+        allocation.block       = blockIndex;
+        allocation.firstVertex = firstVertex;
+        allocation.firstIndex  = firstUnit / (IndexSize(allocation.indexType) / sizeof(uint16_t));
+        return true;
+    }
+} // namespace lumina
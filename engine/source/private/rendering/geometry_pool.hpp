@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include "core/range_allocator.hpp"
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    /**
+     * Shared vertex and index buffers that every mesh is suballocated from.
+     * Meshes are packed into blocks, a block being one vertex buffer and one index buffer with a free list for each. Everything
+     * normally fits in the first block, so the whole frame binds a single index buffer and draws only differ in their offsets.
+     * Another block is only created once the existing ones are full, or for a mesh too large to fit a regular block.
+     *
+     * Index ranges are allocated in 16 bit units, so meshes with 16 and 32 bit indices share the same index buffer. Every
+     * range covers an even number of units, which keeps 32 bit indices 4 byte aligned.
+     */
+    class GeometryPool
+    {
+    public:
+        static constexpr uint32_t BLOCK_VERTEX_COUNT = 1 << 20;
+        // Counted in 32 bit indices.
+        static constexpr uint32_t BLOCK_INDEX_COUNT  = 1 << 22;
+
+        [[nodiscard]] static uint32_t IndexSize(VkIndexType indexType)
+        {
+            return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+        }
+
+        // Has to be called before the first allocation, every mesh in the pool uses the same vertex format.
+        void Init(uint32_t stride);
+        void Cleanup(VmaAllocator allocator);
+
+        // Reserves room for a mesh, the caller uploads the data into the buffers of the returned block.
+        GeometryAllocation Allocate(uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType, VkDevice device, VmaAllocator allocator);
+
+        // The ranges can be reused right away, so the caller has to make sure the GPU no longer reads them.
+        void Free(const GeometryAllocation& allocation);
+
+        [[nodiscard]] VkBuffer VertexBuffer(uint32_t block) const
+        {
+            return blocks[block].vertexBuffer.buffer;
+        }
+
+        [[nodiscard]] VkBuffer IndexBuffer(uint32_t block) const
+        {
+            return blocks[block].indexBuffer.buffer;
+        }
+
+        [[nodiscard]] VkDeviceAddress VertexBufferAddress(uint32_t block) const
+        {
+            return blocks[block].vertexBufferAddress;
+        }
+
+        [[nodiscard]] uint32_t VertexStride() const
+        {
+            return vertexStride;
+        }
+
+        [[nodiscard]] size_t BlockCount() const
+        {
+            return blocks.size();
+        }
+
+    private:
+        struct Block
+        {
+            AllocatedBuffer vertexBuffer {};
+            AllocatedBuffer indexBuffer {};
+            VkDeviceAddress vertexBufferAddress {};
+            RangeAllocator vertices;
+            RangeAllocator indices;
+        };
+
+        static uint32_t IndexUnits(uint32_t indexCount, VkIndexType indexType);
+
+        bool AllocateFromBlock(uint32_t blockIndex, GeometryAllocation& allocation);
+
+        std::vector<Block> blocks;
+        uint32_t vertexStride {sizeof(Vertex)};
+    };
+} // namespace lumina
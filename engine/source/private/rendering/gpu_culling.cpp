@@ -0,0 +1,313 @@
+﻿#include "gpu_culling.hpp"
+
+#include "vk_buffer_utils.hpp"
+#include "vk_initializers.hpp"
+#include "vk_pipelines.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace lumina
+{
+    namespace
+    {
+        constexpr uint32_t CULL_GROUP_SIZE = 64;
+
+        VkDeviceAddress GetBufferAddress(VkDevice device, VkBuffer buffer)
+        {
+            VkBufferDeviceAddressInfo addressInfo {};
+            addressInfo.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+            addressInfo.buffer = buffer;
+            return vkGetBufferDeviceAddress(device, &addressInfo);
+        }
+
+        void BufferBarrier(
+            VkCommandBuffer command,
+            VkPipelineStageFlags2 srcStage,
+            VkAccessFlags2 srcAccess,
+            VkPipelineStageFlags2 dstStage,
+            VkAccessFlags2 dstAccess)
+        {
+            VkMemoryBarrier2 memoryBarrier {};
+            memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+            memoryBarrier.srcStageMask  = srcStage;
+            memoryBarrier.srcAccessMask = srcAccess;
+            memoryBarrier.dstStageMask  = dstStage;
+            memoryBarrier.dstAccessMask = dstAccess;
+
+            VkDependencyInfo dependencyInfo {};
+            dependencyInfo.sType              = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependencyInfo.memoryBarrierCount = 1;
+            dependencyInfo.pMemoryBarriers    = &memoryBarrier;
+
+            vkCmdPipelineBarrier2(command, &dependencyInfo);
+        }
+    } // namespace
+
+    bool GPUCulling::Init(VkDevice device, uint32_t frameCount)
+    {
+        frames.resize(frameCount);
+
+        VkShaderModule cullShader;
+        if (!vkutil::LoadShaderModule("assets/shaders/cull.comp.spv", device, &cullShader))
+        {
+            Log::Error("Error when building GPU Culling Compute Shader, GPU driven culling is unavailable\n");
+            return false;
+        }
+
+        VkPushConstantRange pushConstant {};
+        pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstant.offset     = 0;
+        pushConstant.size       = sizeof(GPUCullPushConstants);
+
+        VkPipelineLayoutCreateInfo layoutInfo = vkinit::PipelineLayoutCreateInfo();
+        layoutInfo.pushConstantRangeCount     = 1;
+        layoutInfo.pPushConstantRanges        = &pushConstant;
+
+        VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &pipelineLayout));
+
+        VkPipelineShaderStageCreateInfo stageInfo {};
+        stageInfo.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+        stageInfo.module = cullShader;
+        stageInfo.pName  = "main";
+
+        VkComputePipelineCreateInfo pipelineInfo {};
+        pipelineInfo.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage  = stageInfo;
+        pipelineInfo.layout = pipelineLayout;
+
+        VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+
+        vkDestroyShaderModule(device, cullShader, nullptr);
+        return true;
+    }
+
+    void GPUCulling::Cleanup(VkDevice device, VmaAllocator allocator)
+    {
+        for (auto& frame : frames)
+        {
+            if (frame.objectCapacity > 0)
+            {
+                DestroyBuffer(allocator, frame.objectBuffer);
+                DestroyBuffer(allocator, frame.commandBuffer);
+            }
+            if (frame.batchCapacity > 0)
+            {
+                DestroyBuffer(allocator, frame.countBuffer);
+            }
+        }
+        frames.clear();
+
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        pipeline       = VK_NULL_HANDLE;
+        pipelineLayout = VK_NULL_HANDLE;
+    }
+
+    void GPUCulling::Prepare(uint32_t frameIndex, const DrawContext& context, VkDevice device, VmaAllocator allocator)
+    {
+        FrameResources& frame = frames[frameIndex];
+        if (frame.contextVersion == context.Version())
+        {
+            return;
+        }
+        frame.contextVersion = context.Version();
+
+        const std::vector<RenderObject>& surfaces = context.OpaqueSurfaces();
+        const CullingBounds& bounds               = context.OpaqueBounds();
+
+        // Group by pipeline and index buffer binding, every group becomes one indirect draw. Materials are looked up per object.
+        sortedSurfaces.clear();
+        frame.fallbackSurfaces.clear();
+        for (uint32_t i = 0; i < surfaces.size(); i++)
+        {
+            if (surfaces[i].material->pipeline->indirectPipeline != VK_NULL_HANDLE)
+            {
+                sortedSurfaces.push_back(i);
+            }
+            else
+            {
+                frame.fallbackSurfaces.push_back(i);
+            }
+        }
+
+        // Sorting by the state keys instead of the pointers keeps the batch order the same from run to run.
+        const std::vector<uint64_t>& sortKeys = context.OpaqueSortKeys();
+        std::stable_sort(sortedSurfaces.begin(), sortedSurfaces.end(), [&](uint32_t a, uint32_t b) {
+            return sortKeys[a] < sortKeys[b];
+        });
+
+        frame.batches.clear();
+        for (uint32_t i = 0; i < sortedSurfaces.size(); i++)
+        {
+            const RenderObject& surface = surfaces[sortedSurfaces[i]];
+            const IndirectBatch* last   = frame.batches.empty() ? nullptr : &frame.batches.back();
+            if (last == nullptr || last->pipeline != surface.material->pipeline || last->indexBuffer != surface.indexBuffer
+                || last->indexType != surface.indexType)
+            {
+                frame.batches.push_back(IndirectBatch {surface.material->pipeline, surface.indexBuffer, surface.indexType, i, 0});
+            }
+            frame.batches.back().maxCommands++;
+        }
+
+        frame.objectCount = static_cast<uint32_t>(sortedSurfaces.size());
+        Reserve(frame, frame.objectCount, static_cast<uint32_t>(frame.batches.size()), device, allocator);
+
+        // The previous submission of this frame has finished, so the object buffer can be written in place.
+        auto* objects = static_cast<GPUObjectData*>(frame.objectBuffer.allocationInfo.pMappedData);
+        for (uint32_t batchIndex = 0; batchIndex < frame.batches.size(); batchIndex++)
+        {
+            const IndirectBatch& batch = frame.batches[batchIndex];
+            for (uint32_t i = batch.firstCommand; i < batch.firstCommand + batch.maxCommands; i++)
+            {
+                const uint32_t index        = sortedSurfaces[i];
+                const RenderObject& surface = surfaces[index];
+
+                GPUObjectData& object  = objects[i];
+                object.transform       = surface.transform;
+                object.center          = float4 {bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index], 0.0f};
+                object.extent          = float4 {bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index], 0.0f};
+                object.firstIndex      = surface.indexOffset + surface.firstIndex;
+                object.indexCount      = surface.indexCount;
+                object.batchIndex      = batchIndex;
+                object.firstCommand    = batch.firstCommand;
+                object.vertexBuffer    = surface.vertexBufferDeviceAddress;
+                object.vertexOffset    = surface.vertexOffset;
+                object.materialIndex   = surface.material->materialIndex;
+                object.positionOrigin  = float4 {surface.bounds.origin, 0.0f};
+                object.positionExtents = float4 {surface.bounds.extents, 0.0f};
+            }
+        }
+
+        if (frame.objectCount > 0)
+        {
+            vmaFlushAllocation(allocator, frame.objectBuffer.allocation, 0, VK_WHOLE_SIZE);
+        }
+    }
+
+    void GPUCulling::RecordCulling(VkCommandBuffer command, uint32_t frameIndex, const Frustum& frustum) const
+    {
+        const FrameResources& frame = frames[frameIndex];
+        if (frame.objectCount == 0)
+        {
+            return;
+        }
+
+        vkCmdFillBuffer(command, frame.countBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+        BufferBarrier(
+            command,
+            VK_PIPELINE_STAGE_2_CLEAR_BIT,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+        GPUCullPushConstants pushConstants {};
+        std::copy(frustum.planes.begin(), frustum.planes.end(), pushConstants.planes);
+        pushConstants.objectBuffer  = frame.objectBufferAddress;
+        pushConstants.commandBuffer = frame.commandBufferAddress;
+        pushConstants.countBuffer   = frame.countBufferAddress;
+        pushConstants.objectCount   = frame.objectCount;
+
+        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdPushConstants(command, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUCullPushConstants), &pushConstants);
+        vkCmdDispatch(command, (frame.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+        BufferBarrier(
+            command,
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
+            VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+    }
+
+    void GPUCulling::RecordDraws(VkCommandBuffer command, uint32_t frameIndex, VkDescriptorSet globalDescriptor, VkDescriptorSet materialDescriptor) const
+    {
+        const FrameResources& frame = frames[frameIndex];
+
+        const MaterialPipeline* lastPipeline = nullptr;
+        VkBuffer lastIndexBuffer             = VK_NULL_HANDLE;
+        VkIndexType lastIndexType            = VK_INDEX_TYPE_UINT32;
+
+        for (uint32_t batchIndex = 0; batchIndex < frame.batches.size(); batchIndex++)
+        {
+            const IndirectBatch& batch = frame.batches[batchIndex];
+            if (batch.pipeline != lastPipeline)
+            {
+                lastPipeline = batch.pipeline;
+                vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, lastPipeline->indirectPipeline);
+
+                const VkDescriptorSet sets[] = {globalDescriptor, materialDescriptor};
+                vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_GRAPHICS, lastPipeline->pipelineLayout, 0, 2, sets, 0, nullptr);
+
+                GPUIndirectPushConstants pushConstants {frame.objectBufferAddress};
+                vkCmdPushConstants(command, lastPipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUIndirectPushConstants), &pushConstants);
+            }
+
+            if (batch.indexBuffer != lastIndexBuffer || batch.indexType != lastIndexType)
+            {
+                lastIndexBuffer = batch.indexBuffer;
+                lastIndexType   = batch.indexType;
+                vkCmdBindIndexBuffer(command, batch.indexBuffer, 0, batch.indexType);
+            }
+            vkCmdDrawIndexedIndirectCount(
+                command,
+                frame.commandBuffer.buffer,
+                batch.firstCommand * sizeof(VkDrawIndexedIndirectCommand),
+                frame.countBuffer.buffer,
+                batchIndex * sizeof(uint32_t),
+                batch.maxCommands,
+                sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+
+    void GPUCulling::Reserve(FrameResources& frame, uint32_t objectCount, uint32_t batchCount, VkDevice device, VmaAllocator allocator) const
+    {
+        if (objectCount > frame.objectCapacity)
+        {
+            if (frame.objectCapacity > 0)
+            {
+                DestroyBuffer(allocator, frame.objectBuffer);
+                DestroyBuffer(allocator, frame.commandBuffer);
+            }
+
+            // Grow with some headroom so streaming in a few more surfaces doesn't reallocate every time.
+            frame.objectCapacity = std::max(objectCount + objectCount / 2, 1024u);
+
+            frame.objectBuffer = CreateBuffer(
+                allocator,
+                frame.objectCapacity * sizeof(GPUObjectData),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_CPU_TO_GPU,
+                MemoryCategory::PerFrame);
+            frame.commandBuffer = CreateBuffer(
+                allocator,
+                frame.objectCapacity * sizeof(VkDrawIndexedIndirectCommand),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY,
+                MemoryCategory::PerFrame);
+
+            frame.objectBufferAddress  = GetBufferAddress(device, frame.objectBuffer.buffer);
+            frame.commandBufferAddress = GetBufferAddress(device, frame.commandBuffer.buffer);
+        }
+
+        if (batchCount > frame.batchCapacity)
+        {
+            if (frame.batchCapacity > 0)
+            {
+                DestroyBuffer(allocator, frame.countBuffer);
+            }
+
+            frame.batchCapacity = std::max(batchCount + batchCount / 2, 256u);
+            frame.countBuffer   = CreateBuffer(
+                allocator,
+                frame.batchCapacity * sizeof(uint32_t),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                    | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                VMA_MEMORY_USAGE_GPU_ONLY,
+                MemoryCategory::PerFrame);
+
+            frame.countBufferAddress = GetBufferAddress(device, frame.countBuffer.buffer);
+        }
+    }
+} // namespace lumina
@@ -0,0 +1,116 @@
+﻿#pragma once
+
+#include "culling.hpp"
+#include "draw_context.hpp"
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    // Matches ObjectData in cull.comp and mesh_indirect.vert.
+    struct GPUObjectData
+    {
+        AffineTransform transform;
+        float4 center;
+        float4 extent;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t batchIndex;
+        uint32_t firstCommand;
+        VkDeviceAddress vertexBuffer;
+        int32_t vertexOffset;
+        uint32_t materialIndex;
+
+        // Object space surface bounds that compact vertex positions are decoded against.
+        float4 positionOrigin;
+        float4 positionExtents;
+    };
+
+    struct GPUCullPushConstants
+    {
+        float4 planes[6];
+        VkDeviceAddress objectBuffer;
+        VkDeviceAddress commandBuffer;
+        VkDeviceAddress countBuffer;
+        uint32_t objectCount;
+    };
+
+    struct GPUIndirectPushConstants
+    {
+        VkDeviceAddress objectBuffer;
+    };
+
+    // Opaque surfaces that share a pipeline and index buffer binding, drawn with a single vkCmdDrawIndexedIndirectCount.
+    struct IndirectBatch
+    {
+        MaterialPipeline* pipeline;
+        VkBuffer indexBuffer;
+        VkIndexType indexType;
+        uint32_t firstCommand;
+        uint32_t maxCommands;
+    };
+
+    /**
+     * GPU driven path for the opaque surfaces of a DrawContext.
+     * Object data is only rewritten when the context changed, after which a compute pass frustum culls every object and appends
+     * a draw command for the visible ones to the commands of its batch. The CPU cost per frame is one dispatch plus one indirect
+     * draw per batch, regardless of the amount of objects.
+     */
+    class GPUCulling
+    {
+    public:
+        bool Init(VkDevice device, uint32_t frameCount);
+        void Cleanup(VkDevice device, VmaAllocator allocator);
+
+        // Rebuilds the object data and batches of this frame if the context changed since they were last written.
+        void Prepare(uint32_t frameIndex, const DrawContext& context, VkDevice device, VmaAllocator allocator);
+
+        // Records the culling dispatch, has to happen outside of dynamic rendering.
+        void RecordCulling(VkCommandBuffer command, uint32_t frameIndex, const Frustum& frustum) const;
+
+        // Records the indirect draws, expects the dynamic state to be set by the caller.
+        void RecordDraws(VkCommandBuffer command, uint32_t frameIndex, VkDescriptorSet globalDescriptor, VkDescriptorSet materialDescriptor) const;
+
+        // Opaque surfaces without an indirect pipeline, these still have to be drawn one by one.
+        [[nodiscard]] const std::vector<uint32_t>& FallbackSurfaces(uint32_t frameIndex) const
+        {
+            return frames[frameIndex].fallbackSurfaces;
+        }
+
+        [[nodiscard]] size_t BatchCount(uint32_t frameIndex) const
+        {
+            return frames[frameIndex].batches.size();
+        }
+
+        [[nodiscard]] bool IsAvailable() const
+        {
+            return pipeline != VK_NULL_HANDLE;
+        }
+
+    private:
+        struct FrameResources
+        {
+            AllocatedBuffer objectBuffer {};
+            AllocatedBuffer commandBuffer {};
+            AllocatedBuffer countBuffer {};
+            VkDeviceAddress objectBufferAddress {};
+            VkDeviceAddress commandBufferAddress {};
+            VkDeviceAddress countBufferAddress {};
+            uint32_t objectCapacity {0};
+            uint32_t batchCapacity {0};
+
+            uint32_t objectCount {0};
+            uint64_t contextVersion {UINT64_MAX};
+            std::vector<IndirectBatch> batches;
+            std::vector<uint32_t> fallbackSurfaces;
+        };
+
+        void Reserve(FrameResources& frame, uint32_t objectCount, uint32_t batchCount, VkDevice device, VmaAllocator allocator) const;
+
+        VkPipeline pipeline {VK_NULL_HANDLE};
+        VkPipelineLayout pipelineLayout {VK_NULL_HANDLE};
+        std::vector<FrameResources> frames;
+        std::vector<uint32_t> sortedSurfaces;
+    };
+} // namespace lumina
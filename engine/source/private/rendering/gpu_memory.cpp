@@ -0,0 +1,69 @@
+﻿#include "gpu_memory.hpp"
+
+#include <atomic>
+#include <cassert>
+
+namespace lumina
+{
+    namespace
+    {
+        struct Counters
+        {
+            std::atomic<VkDeviceSize> bytes {0};
+            std::atomic<uint32_t> allocationCount {0};
+        };
+
+        Counters counters[static_cast<size_t>(MemoryCategory::Count)];
+    } // namespace
+
+    const char* ToString(MemoryCategory category)
+    {
+        switch (category)
+        {
+            case MemoryCategory::Geometry: return "Geometry";
+            case MemoryCategory::Textures: return "Textures";
+            case MemoryCategory::RenderTargets: return "Render Targets";
+            case MemoryCategory::Staging: return "Staging";
+            case MemoryCategory::PerFrame: return "Per Frame";
+            case MemoryCategory::Materials: return "Materials";
+            default: return "Unknown";
+        }
+    }
+
+    void GPUMemory::Track(VmaAllocator allocator, VmaAllocation allocation, MemoryCategory category)
+    {
+        assert(category < MemoryCategory::Count);
+
+        vmaSetAllocationUserData(allocator, allocation, reinterpret_cast<void*>(static_cast<uintptr_t>(category)));
+
+        VmaAllocationInfo info;
+        vmaGetAllocationInfo(allocator, allocation, &info);
+
+        Counters& counter = counters[static_cast<size_t>(category)];
+        counter.bytes += info.size;
+        counter.allocationCount++;
+    }
+
+    void GPUMemory::Untrack(VmaAllocator allocator, VmaAllocation allocation)
+    {
+        VmaAllocationInfo info;
+        vmaGetAllocationInfo(allocator, allocation, &info);
+
+        const auto category = static_cast<size_t>(reinterpret_cast<uintptr_t>(info.pUserData));
+        assert(category < static_cast<size_t>(MemoryCategory::Count));
+
+        Counters& counter = counters[category];
+        counter.bytes -= info.size;
+        counter.allocationCount--;
+    }
+
+    MemoryCategoryUsage GPUMemory::Usage(MemoryCategory category)
+    {
+        const Counters& counter = counters[static_cast<size_t>(category)];
+
+        MemoryCategoryUsage usage;
+        usage.bytes           = counter.bytes.load();
+        usage.allocationCount = counter.allocationCount.load();
+        return usage;
+    }
+} // namespace lumina
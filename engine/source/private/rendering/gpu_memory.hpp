@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include "vk_types.hpp"
+
+namespace lumina
+{
+    enum class MemoryCategory : uint8_t
+    {
+        Geometry,
+        Textures,
+        RenderTargets,
+        Staging,
+        PerFrame,
+        Materials,
+        Count,
+    };
+
+    const char* ToString(MemoryCategory category);
+
+    struct MemoryCategoryUsage
+    {
+        VkDeviceSize bytes {0};
+        uint32_t allocationCount {0};
+    };
+
+    /**
+     * Process wide accounting of VMA allocations per MemoryCategory.
+     * Track stores the category in the user data of the allocation, so Untrack only needs the allocation itself and every
+     * destruction path, including deferred ones, stays in balance. Counters are atomic, allocations may be made from any thread.
+     */
+    class GPUMemory
+    {
+    public:
+        // Call right after the allocation was created.
+        static void Track(VmaAllocator allocator, VmaAllocation allocation, MemoryCategory category);
+        // Call right before the allocation is freed.
+        static void Untrack(VmaAllocator allocator, VmaAllocation allocation);
+
+        [[nodiscard]] static MemoryCategoryUsage Usage(MemoryCategory category);
+    };
+} // namespace lumina
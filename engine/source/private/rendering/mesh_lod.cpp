@@ -0,0 +1,401 @@
+﻿#include "mesh_lod.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <queue>
+#include <tuple>
+
+namespace lumina
+{
+    namespace
+    {
+        // Symmetric 4x4 matrix summing the squared distances to a set of planes, weighted by the area of the triangle each came from.
+        struct Quadric
+        {
+            double xx {0.0};
+            double xy {0.0};
+            double xz {0.0};
+            double xw {0.0};
+            double yy {0.0};
+            double yz {0.0};
+            double yw {0.0};
+            double zz {0.0};
+            double zw {0.0};
+            double ww {0.0};
+            double weight {0.0};
+
+            void AddPlane(const glm::dvec3& normal, double distance, double area)
+            {
+                xx += normal.x * normal.x * area;
+                xy += normal.x * normal.y * area;
+                xz += normal.x * normal.z * area;
+                xw += normal.x * distance * area;
+                yy += normal.y * normal.y * area;
+                yz += normal.y * normal.z * area;
+                yw += normal.y * distance * area;
+                zz += normal.z * normal.z * area;
+                zw += normal.z * distance * area;
+                ww += distance * distance * area;
+                weight += area;
+            }
+
+            void Add(const Quadric& other)
+            {
+                xx += other.xx;
+                xy += other.xy;
+                xz += other.xz;
+                xw += other.xw;
+                yy += other.yy;
+                yz += other.yz;
+                yw += other.yw;
+                zz += other.zz;
+                zw += other.zw;
+                ww += other.ww;
+                weight += other.weight;
+            }
+
+            [[nodiscard]] double Evaluate(const float3& position) const
+            {
+                const double x = position.x;
+                const double y = position.y;
+                const double z = position.z;
+
+                const double result = xx * x * x + yy * y * y + zz * z * z + 2.0 * (xy * x * y + xz * x * z + yz * y * z + xw * x + yw * y + zw * z) + ww;
+                return std::max(result, 0.0);
+            }
+        };
+
+        struct Collapse
+        {
+            double cost;
+            uint32_t from;
+            uint32_t to;
+
+            bool operator>(const Collapse& other) const
+            {
+                return cost > other.cost;
+            }
+        };
+
+        glm::dvec3 TriangleNormal(const float3& p0, const float3& p1, const float3& p2)
+        {
+            return glm::cross(glm::dvec3(p1) - glm::dvec3(p0), glm::dvec3(p2) - glm::dvec3(p0));
+        }
+    } // namespace
+
+    std::vector<uint32_t> SimplifyMesh(tcb::span<const float3> positions, tcb::span<const uint32_t> indices, uint32_t targetIndexCount, float& outError)
+    {
+        outError = 0.0f;
+
+        // Work on a compact numbering of the vertices the triangles actually reference.
+        std::vector<uint32_t> vertexIds(indices.begin(), indices.end());
+        std::sort(vertexIds.begin(), vertexIds.end());
+        vertexIds.erase(std::unique(vertexIds.begin(), vertexIds.end()), vertexIds.end());
+
+        const auto vertexCount   = static_cast<uint32_t>(vertexIds.size());
+        const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+
+        std::vector<uint32_t> corners(triangleCount * 3);
+        for (size_t i = 0; i < corners.size(); i++)
+        {
+            corners[i] = static_cast<uint32_t>(std::lower_bound(vertexIds.begin(), vertexIds.end(), indices[i]) - vertexIds.begin());
+        }
+
+        auto position = [&](uint32_t vertex) -> const float3& {
+            return positions[vertexIds[vertex]];
+        };
+
+        // Vertices sharing a position are welded, the error metric and the border detection both work on welded vertices.
+        std::vector<uint32_t> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const float3& pa = position(a);
+            const float3& pb = position(b);
+            return std::tie(pa.x, pa.y, pa.z) < std::tie(pb.x, pb.y, pb.z);
+        });
+
+        std::vector<uint32_t> weld(vertexCount);
+        std::vector<uint32_t> weldSize;
+        for (uint32_t i = 0; i < vertexCount; i++)
+        {
+            if (i == 0 || position(order[i]) != position(order[i - 1]))
+            {
+                weldSize.push_back(0);
+            }
+            weld[order[i]] = static_cast<uint32_t>(weldSize.size()) - 1;
+            weldSize.back()++;
+        }
+
+        std::vector<Quadric> quadrics(weldSize.size());
+        std::vector<bool> triangleAlive(triangleCount, true);
+        std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+        std::vector<uint64_t> edges;
+        uint32_t aliveCount = 0;
+
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            const uint32_t* corner = &corners[t * 3];
+            if (corner[0] == corner[1] || corner[1] == corner[2] || corner[2] == corner[0])
+            {
+                triangleAlive[t] = false;
+                continue;
+            }
+            aliveCount++;
+
+            const glm::dvec3 normal = TriangleNormal(position(corner[0]), position(corner[1]), position(corner[2]));
+            const double length     = glm::length(normal);
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                vertexTriangles[corner[k]].push_back(t);
+
+                if (length > 0.0)
+                {
+                    const glm::dvec3 unitNormal = normal / length;
+                    quadrics[weld[corner[k]]].AddPlane(unitNormal, -glm::dot(unitNormal, glm::dvec3(position(corner[0]))), length * 0.5);
+                }
+
+                const uint32_t a = weld[corner[k]];
+                const uint32_t b = weld[corner[(k + 1) % 3]];
+                if (a != b)
+                {
+                    edges.push_back(static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b));
+                }
+            }
+        }
+
+        // Seams store one position more than once with different attributes, moving either copy would tear the surface open.
+        // Open and non manifold edges are locked as well so the outline of the mesh stays in place.
+        std::vector<bool> locked(weldSize.size());
+        for (size_t w = 0; w < weldSize.size(); w++)
+        {
+            locked[w] = weldSize[w] > 1;
+        }
+
+        std::sort(edges.begin(), edges.end());
+        for (size_t begin = 0, end = 0; begin < edges.size(); begin = end)
+        {
+            while (end < edges.size() && edges[end] == edges[begin])
+            {
+                end++;
+            }
+            if (end - begin != 2)
+            {
+                locked[edges[begin] >> 32]        = true;
+                locked[edges[begin] & 0xffffffff] = true;
+            }
+        }
+
+        auto collapseCost = [&](uint32_t from, uint32_t to) {
+            Quadric quadric = quadrics[weld[from]];
+            quadric.Add(quadrics[weld[to]]);
+            return quadric.Evaluate(position(to));
+        };
+
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue;
+        auto pushCollapse = [&](uint32_t from, uint32_t to) {
+            if (!locked[weld[from]] && weld[from] != weld[to])
+            {
+                queue.push(Collapse {collapseCost(from, to), from, to});
+            }
+        };
+
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            if (triangleAlive[t])
+            {
+                // The neighboring triangle holds the same edge in the other direction.
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    pushCollapse(corners[t * 3 + k], corners[t * 3 + (k + 1) % 3]);
+                }
+            }
+        }
+
+        std::vector<bool> collapsed(vertexCount, false);
+        std::vector<uint32_t> neighbors;
+        double maxError = 0.0;
+
+        while (aliveCount * 3 > targetIndexCount && !queue.empty())
+        {
+            const Collapse collapse = queue.top();
+            queue.pop();
+
+            if (collapsed[collapse.from] || collapsed[collapse.to])
+            {
+                continue;
+            }
+
+            // Quadrics only grow, so an entry whose cost went up since it was queued goes back in at its new cost.
+            const double cost = collapseCost(collapse.from, collapse.to);
+            if (cost > collapse.cost)
+            {
+                queue.push(Collapse {cost, collapse.from, collapse.to});
+                continue;
+            }
+
+            // The edge has to still exist, and none of the remaining triangles around the vertex may flip or degenerate.
+            bool sharesEdge = false;
+            bool flips      = false;
+            for (uint32_t t : vertexTriangles[collapse.from])
+            {
+                if (!triangleAlive[t])
+                {
+                    continue;
+                }
+
+                const uint32_t* corner = &corners[t * 3];
+                if (corner[0] == collapse.to || corner[1] == collapse.to || corner[2] == collapse.to)
+                {
+                    sharesEdge = true;
+                    continue;
+                }
+
+                float3 moved[3];
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    moved[k] = position(corner[k] == collapse.from ? collapse.to : corner[k]);
+                }
+
+                const glm::dvec3 before = TriangleNormal(position(corner[0]), position(corner[1]), position(corner[2]));
+                const glm::dvec3 after  = TriangleNormal(moved[0], moved[1], moved[2]);
+                if (glm::dot(before, after) < 0.25 * glm::length(before) * glm::length(after) || glm::dot(after, after) == 0.0)
+                {
+                    flips = true;
+                    break;
+                }
+            }
+
+            if (!sharesEdge || flips)
+            {
+                continue;
+            }
+
+            neighbors.clear();
+            for (uint32_t t : vertexTriangles[collapse.from])
+            {
+                if (!triangleAlive[t])
+                {
+                    continue;
+                }
+
+                uint32_t* corner = &corners[t * 3];
+                if (corner[0] == collapse.to || corner[1] == collapse.to || corner[2] == collapse.to)
+                {
+                    triangleAlive[t] = false;
+                    aliveCount--;
+                    continue;
+                }
+
+                std::replace(corner, corner + 3, collapse.from, collapse.to);
+                vertexTriangles[collapse.to].push_back(t);
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    if (corner[k] != collapse.to)
+                    {
+                        neighbors.push_back(corner[k]);
+                    }
+                }
+            }
+
+            collapsed[collapse.from] = true;
+
+            Quadric& merged = quadrics[weld[collapse.to]];
+            merged.Add(quadrics[weld[collapse.from]]);
+            if (merged.weight > 0.0)
+            {
+                maxError = std::max(maxError, merged.Evaluate(position(collapse.to)) / merged.weight);
+            }
+
+            std::vector<uint32_t>& around = vertexTriangles[collapse.to];
+            around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return !triangleAlive[t]; }), around.end());
+
+            // Edges that already existed are updated lazily when they come up, only the ones the collapse created are queued.
+            std::sort(neighbors.begin(), neighbors.end());
+            neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+            for (uint32_t neighbor : neighbors)
+            {
+                pushCollapse(neighbor, collapse.to);
+                pushCollapse(collapse.to, neighbor);
+            }
+        }
+
+        std::vector<uint32_t> result;
+        result.reserve(aliveCount * 3);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            if (triangleAlive[t])
+            {
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    result.push_back(vertexIds[corners[t * 3 + k]]);
+                }
+            }
+        }
+
+        outError = static_cast<float>(std::sqrt(maxError));
+        return result;
+    }
+
+    std::vector<MeshLod> GenerateLods(tcb::span<const float3> positions, std::vector<uint32_t>& indices, uint32_t startIndex, uint32_t indexCount)
+    {
+        std::vector<MeshLod> lods;
+        lods.push_back(MeshLod {startIndex, indexCount, 0.0f});
+
+        std::vector<uint32_t> current(indices.begin() + startIndex, indices.begin() + startIndex + indexCount);
+        float error = 0.0f;
+
+        while (lods.size() < MAX_MESH_LODS && current.size() / 3 >= MIN_LOD_TRIANGLES)
+        {
+            float levelError;
+            std::vector<uint32_t> simplified = SimplifyMesh(positions, current, static_cast<uint32_t>(current.size() / 6 * 3), levelError);
+
+            // Locked borders and seams eventually keep the simplifier from making real progress, another level isn't worth it then.
+            if (simplified.size() > current.size() * 3 / 4)
+            {
+                break;
+            }
+
+            // Every level is simplified from the previous one, so their errors add up.
+            error += levelError;
+            lods.push_back(MeshLod {static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()), error});
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            current = std::move(simplified);
+        }
+
+        return lods;
+    }
+
+    uint32_t SelectLod(
+        tcb::span<const MeshLod> lods,
+        const Bounds& bounds,
+        const AffineTransform& transform,
+        const float3& cameraPosition,
+        float pixelScale,
+        float maxError)
+    {
+        if (lods.size() <= 1)
+        {
+            return 0;
+        }
+
+        const float3 center = transform.TransformPoint(bounds.origin);
+        const float scale   = std::max({glm::length(transform.Axis(0)), glm::length(transform.Axis(1)), glm::length(transform.Axis(2))});
+
+        // Inside the bounding sphere the surface can be arbitrarily close, only full detail is safe there.
+        const float distance = glm::distance(center, cameraPosition) - bounds.sphereRadius * scale;
+        if (distance <= 0.0f)
+        {
+            return 0;
+        }
+
+        const float errorToPixels = scale * pixelScale / distance;
+
+        uint32_t selected = 0;
+        while (selected + 1 < lods.size() && lods[selected + 1].error * errorToPixels <= maxError)
+        {
+            selected++;
+        }
+        return selected;
+    }
+} // namespace lumina
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include "core/span.hpp"
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    // Levels per surface, the full detail one included.
+    constexpr uint32_t MAX_MESH_LODS = 5;
+
+    // Surfaces with fewer triangles than this are always drawn at full detail.
+    constexpr uint32_t MIN_LOD_TRIANGLES = 256;
+
+    /**
+     * Quadric error metric simplification.
+     * Edges are collapsed cheapest first onto one of their endpoints, so the result only references vertices of the input and
+     * can share its vertex buffer. Vertices on open borders or on attribute seams never move, which keeps the silhouette and
+     * avoids cracks where the same position is stored more than once.
+     *
+     * Returns the simplified index list, with outError set to the largest error of any collapse as an object space distance.
+     */
+    std::vector<uint32_t> SimplifyMesh(tcb::span<const float3> positions, tcb::span<const uint32_t> indices, uint32_t targetIndexCount, float& outError);
+
+    // Appends a chain of simplified versions of [startIndex, startIndex + indexCount) to indices.
+    // The returned levels go from full detail to coarsest, the first one being the original range.
+    std::vector<MeshLod> GenerateLods(tcb::span<const float3> positions, std::vector<uint32_t>& indices, uint32_t startIndex, uint32_t indexCount);
+
+    // Picks the coarsest level whose error, projected at the distance of the surface, stays below maxError pixels.
+    // pixelScale is the size in pixels of one world unit at a distance of one.
+    uint32_t SelectLod(
+        tcb::span<const MeshLod> lods,
+        const Bounds& bounds,
+        const AffineTransform& transform,
+        const float3& cameraPosition,
+        float pixelScale,
+        float maxError);
+} // namespace lumina
@@ -0,0 +1,233 @@
+﻿#include "occlusion_culling.hpp"
+
+#include "core/simd.hpp"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace lumina
+{
+    namespace
+    {
+        // Edge function A * x + B * y + C, positive on the inner side of the edge.
+        struct EdgeFunction
+        {
+            float a;
+            float b;
+            float c;
+        };
+
+        EdgeFunction MakeEdge(const float3& from, const float3& to)
+        {
+            return EdgeFunction {from.y - to.y, to.x - from.x, from.x * to.y - from.y * to.x};
+        }
+
+        // Returns false for points that are not strictly in front of the near plane.
+        bool ToScreen(const float4& clip, float3& outScreen)
+        {
+            if (clip.w <= 0.0f || clip.z > clip.w)
+            {
+                return false;
+            }
+
+            const float invW = 1.0f / clip.w;
+            outScreen.x      = (clip.x * invW * 0.5f + 0.5f) * static_cast<float>(OcclusionBuffer::WIDTH);
+            outScreen.y      = (clip.y * invW * 0.5f + 0.5f) * static_cast<float>(OcclusionBuffer::HEIGHT);
+            outScreen.z      = clip.z * invW;
+            return true;
+        }
+    } // namespace
+
+    OcclusionBuffer::OcclusionBuffer()
+        : depth(WIDTH * HEIGHT, 0.0f)
+    {
+        static_assert(WIDTH % 4 == 0, "Rows are processed four pixels at a time");
+    }
+
+    void OcclusionBuffer::Clear(const glm::mat4& newViewProjection)
+    {
+        viewProjection = newViewProjection;
+        std::fill(depth.begin(), depth.end(), 0.0f);
+    }
+
+    void OcclusionBuffer::RasterizeOccluder(const OccluderGeometry& geometry, uint32_t firstIndex, uint32_t indexCount, const AffineTransform& transform)
+    {
+        const glm::mat4 matrix = viewProjection * transform.ToMatrix();
+
+        for (uint32_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3)
+        {
+            const float4 v0 = matrix * float4(geometry.positions[geometry.indices[i + 0]], 1.0f);
+            const float4 v1 = matrix * float4(geometry.positions[geometry.indices[i + 1]], 1.0f);
+            const float4 v2 = matrix * float4(geometry.positions[geometry.indices[i + 2]], 1.0f);
+
+            RasterizeTriangle(v0, v1, v2);
+        }
+    }
+
+    bool OcclusionBuffer::IsVisible(const float3& center, const float3& extent) const
+    {
+        auto screenMin = float2 {FLT_MAX};
+        auto screenMax = float2 {-FLT_MAX};
+        float nearestDepth {0.0f};
+
+        for (int c = 0; c < 8; c++)
+        {
+            const float3 corner {
+                center.x + ((c & 1) ? extent.x : -extent.x),
+                center.y + ((c & 2) ? extent.y : -extent.y),
+                center.z + ((c & 4) ? extent.z : -extent.z),
+            };
+
+            float3 screen;
+            if (!ToScreen(viewProjection * float4(corner, 1.0f), screen))
+            {
+                return true;
+            }
+
+            screenMin    = glm::min(screenMin, float2 {screen.x, screen.y});
+            screenMax    = glm::max(screenMax, float2 {screen.x, screen.y});
+            nearestDepth = std::max(nearestDepth, screen.z);
+        }
+
+        // Every pixel the rectangle touches is tested, partially covered ones included.
+        const int minX = std::max(static_cast<int>(std::floor(screenMin.x)), 0);
+        const int minY = std::max(static_cast<int>(std::floor(screenMin.y)), 0);
+        const int maxX = std::min(static_cast<int>(std::floor(screenMax.x)), static_cast<int>(WIDTH) - 1);
+        const int maxY = std::min(static_cast<int>(std::floor(screenMax.y)), static_cast<int>(HEIGHT) - 1);
+
+        // Off screen, that is up to the frustum test.
+        if (minX > maxX || minY > maxY)
+        {
+            return true;
+        }
+
+#if defined(LUMINA_SIMD_SSE)
+        // Starting on a multiple of four only adds pixels to the test, which can't hide anything that was visible.
+        const __m128 boxDepth = _mm_set1_ps(nearestDepth);
+        for (int y = minY; y <= maxY; y++)
+        {
+            const float* row = depth.data() + y * WIDTH;
+            for (int x = minX & ~3; x <= maxX; x += 4)
+            {
+                if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+                {
+                    return true;
+                }
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; y++)
+        {
+            const float* row = depth.data() + y * WIDTH;
+            for (int x = minX; x <= maxX; x++)
+            {
+                if (row[x] <= nearestDepth)
+                {
+                    return true;
+                }
+            }
+        }
+#endif
+        return false;
+    }
+
+    void OcclusionBuffer::RasterizeTriangle(const float4& clip0, const float4& clip1, const float4& clip2)
+    {
+        // Clipping is skipped, an occluder that crosses the near plane simply doesn't occlude anything.
+        float3 v0, v1, v2;
+        if (!ToScreen(clip0, v0) || !ToScreen(clip1, v1) || !ToScreen(clip2, v2))
+        {
+            return;
+        }
+
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::abs(area) < 1e-6f)
+        {
+            return;
+        }
+
+        const int minX = std::max(static_cast<int>(std::floor(std::min({v0.x, v1.x, v2.x}))), 0);
+        const int minY = std::max(static_cast<int>(std::floor(std::min({v0.y, v1.y, v2.y}))), 0);
+        const int maxX = std::min(static_cast<int>(std::ceil(std::max({v0.x, v1.x, v2.x}))), static_cast<int>(WIDTH) - 1);
+        const int maxY = std::min(static_cast<int>(std::ceil(std::max({v0.y, v1.y, v2.y}))), static_cast<int>(HEIGHT) - 1);
+        if (minX > maxX || minY > maxY)
+        {
+            return;
+        }
+
+        EdgeFunction e0 = MakeEdge(v1, v2);
+        EdgeFunction e1 = MakeEdge(v2, v0);
+        EdgeFunction e2 = MakeEdge(v0, v1);
+
+        // Occluders are rendered double sided, flip the edges of clockwise triangles so the inside is always positive.
+        if (area < 0.0f)
+        {
+            for (EdgeFunction* edge : {&e0, &e1, &e2})
+            {
+                edge->a = -edge->a;
+                edge->b = -edge->b;
+                edge->c = -edge->c;
+            }
+            area = -area;
+        }
+
+        // The edge functions are the barycentrics scaled by the area, which gives the depth as a plane over the screen.
+        const float invArea = 1.0f / area;
+        const float depthA  = (e0.a * v0.z + e1.a * v1.z + e2.a * v2.z) * invArea;
+        const float depthB  = (e0.b * v0.z + e1.b * v1.z + e2.b * v2.z) * invArea;
+        const float depthC  = (e0.c * v0.z + e1.c * v1.z + e2.c * v2.z) * invArea;
+
+#if defined(LUMINA_SIMD_SSE)
+        const __m128 zero        = _mm_setzero_ps();
+        const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            const float pixelY = static_cast<float>(y) + 0.5f;
+            const __m128 row0  = _mm_set1_ps(e0.b * pixelY + e0.c);
+            const __m128 row1  = _mm_set1_ps(e1.b * pixelY + e1.c);
+            const __m128 row2  = _mm_set1_ps(e2.b * pixelY + e2.c);
+            const __m128 rowZ  = _mm_set1_ps(depthB * pixelY + depthC);
+            float* row         = depth.data() + y * WIDTH;
+
+            // Lanes outside of [minX, maxX] are outside of the triangle as well, so they need no extra mask.
+            for (int x = minX & ~3; x <= maxX; x += 4)
+            {
+                const __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                const __m128 w0     = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e0.a), pixelX), row0);
+                const __m128 w1     = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e1.a), pixelX), row1);
+                const __m128 w2     = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2.a), pixelX), row2);
+
+                const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w0, zero), _mm_cmpge_ps(w1, zero)), _mm_cmpge_ps(w2, zero));
+                if (_mm_movemask_ps(inside) == 0)
+                {
+                    continue;
+                }
+
+                const __m128 triangleDepth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depthA), pixelX), rowZ);
+                const __m128 current       = _mm_loadu_ps(row + x);
+                const __m128 closest       = _mm_max_ps(current, triangleDepth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, current)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; y++)
+        {
+            const float pixelY = static_cast<float>(y) + 0.5f;
+            float* row         = depth.data() + y * WIDTH;
+
+            for (int x = minX; x <= maxX; x++)
+            {
+                const float pixelX = static_cast<float>(x) + 0.5f;
+                const float w0     = e0.a * pixelX + e0.b * pixelY + e0.c;
+                const float w1     = e1.a * pixelX + e1.b * pixelY + e1.c;
+                const float w2     = e2.a * pixelX + e2.b * pixelY + e2.c;
+                if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+                {
+                    row[x] = std::max(row[x], depthA * pixelX + depthB * pixelY + depthC);
+                }
+            }
+        }
+#endif
+    }
+} // namespace lumina
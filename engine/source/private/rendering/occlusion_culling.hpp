@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    // Meshes with more triangles than this don't keep a CPU copy and are never used as occluders.
+    constexpr uint32_t MAX_OCCLUDER_TRIANGLES = 4096;
+
+    /**
+     * Small software depth buffer for occlusion culling on the CPU.
+     * A few large occluders are rasterized into it every frame, after which the screen space rectangle of every candidate box
+     * is compared against it. Depth is stored like the main depth buffer, with reversed Z, so a larger value is closer.
+     *
+     * Both rasterization and testing handle four pixels of a row at once. Anything touching or crossing the near plane is
+     * treated as visible and is never rasterized as an occluder, so the test only errs on the side of drawing too much.
+     */
+    class OcclusionBuffer
+    {
+    public:
+        static constexpr uint32_t WIDTH  = 320;
+        static constexpr uint32_t HEIGHT = 180;
+
+        OcclusionBuffer();
+
+        void Clear(const glm::mat4& viewProjection);
+
+        // Rasterizes indexCount indices starting at firstIndex, with the positions transformed by transform.
+        void RasterizeOccluder(const OccluderGeometry& geometry, uint32_t firstIndex, uint32_t indexCount, const AffineTransform& transform);
+
+        // Tests a world space box, returns false only when every pixel it covers is behind an occluder.
+        [[nodiscard]] bool IsVisible(const float3& center, const float3& extent) const;
+
+        [[nodiscard]] const std::vector<float>& Depth() const
+        {
+            return depth;
+        }
+
+    private:
+        void RasterizeTriangle(const float4& clip0, const float4& clip1, const float4& clip2);
+
+        glm::mat4 viewProjection {1.0f};
+        std::vector<float> depth;
+    };
+} // namespace lumina
@@ -0,0 +1,106 @@
+﻿#include "retirement_queue.hpp"
+
+#include "bindless_materials.hpp"
+#include "geometry_pool.hpp"
+#include "gpu_memory.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace lumina
+{
+    void RetirementQueue::Retire(const AllocatedBuffer& buffer, uint64_t frame)
+    {
+        Entry& entry     = Push(ResourceType::Buffer, frame);
+        entry.buffer     = buffer.buffer;
+        entry.allocation = buffer.allocation;
+    }
+
+    void RetirementQueue::Retire(const AllocatedImage& image, uint64_t frame)
+    {
+        Entry& entry     = Push(ResourceType::Image, frame);
+        entry.image      = image.image;
+        entry.imageView  = image.imageView;
+        entry.allocation = image.allocation;
+    }
+
+    void RetirementQueue::Retire(VkSampler sampler, uint64_t frame)
+    {
+        Push(ResourceType::Sampler, frame).sampler = sampler;
+    }
+
+    void RetirementQueue::Retire(GeometryPool& geometryPool, const GeometryAllocation& geometry, uint64_t frame)
+    {
+        Entry& entry       = Push(ResourceType::GeometryRange, frame);
+        entry.geometryPool = &geometryPool;
+        entry.geometry     = geometry;
+    }
+
+    void RetirementQueue::Retire(BindlessMaterials& bindlessMaterials, uint32_t materialIndex, uint64_t frame)
+    {
+        Entry& entry            = Push(ResourceType::MaterialSlot, frame);
+        entry.bindlessMaterials = &bindlessMaterials;
+        entry.materialIndex     = materialIndex;
+    }
+
+    void RetirementQueue::Collect(VkDevice device, VmaAllocator allocator, uint64_t completed)
+    {
+        const auto end = std::find_if(entries.begin(), entries.end(), [completed](const Entry& entry) {
+            return entry.frame > completed;
+        });
+        if (end == entries.begin())
+        {
+            return;
+        }
+
+        for (auto it = entries.begin(); it != end; ++it)
+        {
+            Destroy(device, allocator, *it);
+        }
+        entries.erase(entries.begin(), end);
+    }
+
+    void RetirementQueue::Flush(VkDevice device, VmaAllocator allocator)
+    {
+        for (const Entry& entry : entries)
+        {
+            Destroy(device, allocator, entry);
+        }
+        entries.clear();
+    }
+
+    RetirementQueue::Entry& RetirementQueue::Push(ResourceType type, uint64_t frame)
+    {
+        assert(entries.empty() || entries.back().frame <= frame);
+
+        Entry& entry = entries.emplace_back();
+        entry.type   = type;
+        entry.frame  = frame;
+        return entry;
+    }
+
+    void RetirementQueue::Destroy(VkDevice device, VmaAllocator allocator, const Entry& entry)
+    {
+        switch (entry.type)
+        {
+            case ResourceType::Buffer:
+                GPUMemory::Untrack(allocator, entry.allocation);
+                vmaDestroyBuffer(allocator, entry.buffer, entry.allocation);
+                break;
+            case ResourceType::Image:
+                vkDestroyImageView(device, entry.imageView, nullptr);
+                GPUMemory::Untrack(allocator, entry.allocation);
+                vmaDestroyImage(allocator, entry.image, entry.allocation);
+                break;
+            case ResourceType::Sampler:
+                vkDestroySampler(device, entry.sampler, nullptr);
+                break;
+            case ResourceType::GeometryRange:
+                entry.geometryPool->Free(entry.geometry);
+                break;
+            case ResourceType::MaterialSlot:
+                entry.bindlessMaterials->RemoveMaterial(entry.materialIndex);
+                break;
+        }
+    }
+} // namespace lumina
@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    class BindlessMaterials;
+    class GeometryPool;
+
+    /**
+     * Defers destruction of GPU resources until the frames that may still use them have completed.
+     * Every entry is a plain record of the handles to destroy, tagged with the frame it was retired in. Frames only grow, so the
+     * entries are ordered and Collect destroys a prefix of one flat vector in bulk. Its capacity is kept around, so once it has
+     * grown to the usual number of resources per frame retiring costs no heap allocations at all.
+     *
+     * Geometry ranges and bindless material slots are retired the same way, collecting them hands them back to their pool.
+     */
+    class RetirementQueue
+    {
+    public:
+        void Retire(const AllocatedBuffer& buffer, uint64_t frame);
+        void Retire(const AllocatedImage& image, uint64_t frame);
+        void Retire(VkSampler sampler, uint64_t frame);
+        void Retire(GeometryPool& geometryPool, const GeometryAllocation& geometry, uint64_t frame);
+        void Retire(BindlessMaterials& bindlessMaterials, uint32_t materialIndex, uint64_t frame);
+
+        // Destroys everything retired in frames up to completed.
+        void Collect(VkDevice device, VmaAllocator allocator, uint64_t completed);
+        // Destroys everything, the device has to be idle and the pools of retired ranges and slots still alive.
+        void Flush(VkDevice device, VmaAllocator allocator);
+
+        [[nodiscard]] size_t Size() const
+        {
+            return entries.size();
+        }
+
+    private:
+        enum class ResourceType : uint8_t
+        {
+            Buffer,
+            Image,
+            Sampler,
+            GeometryRange,
+            MaterialSlot,
+        };
+
+        struct Entry
+        {
+            ResourceType type;
+            uint64_t frame;
+            union
+            {
+                VkBuffer buffer;
+                VkImage image;
+                VkSampler sampler;
+                GeometryPool* geometryPool;
+                BindlessMaterials* bindlessMaterials;
+            };
+            VkImageView imageView {VK_NULL_HANDLE};
+            VmaAllocation allocation {VK_NULL_HANDLE};
+            GeometryAllocation geometry {};
+            uint32_t materialIndex {0};
+        };
+
+        Entry& Push(ResourceType type, uint64_t frame);
+        static void Destroy(VkDevice device, VmaAllocator allocator, const Entry& entry);
+
+        std::vector<Entry> entries;
+    };
+} // namespace lumina
@@ -0,0 +1,98 @@
+﻿#include "staging_ring.hpp"
+
+#include "vk_buffer_utils.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace lumina
+{
+    void StagingRing::Init(VmaAllocator allocator, VkDeviceSize ringCapacity)
+    {
+        assert(ringCapacity % ALIGNMENT == 0);
+
+        capacity = ringCapacity;
+        buffer   = CreateBuffer(allocator, capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MemoryCategory::Staging);
+    }
+
+    void StagingRing::Cleanup(VmaAllocator allocator)
+    {
+        DestroyBuffer(allocator, buffer);
+        regions.clear();
+        head = 0;
+        tail = 0;
+        used = 0;
+    }
+
+    StagingAllocation StagingRing::Allocate(VkDeviceSize size, VkDeviceSize granularity, UploadTicket ticket)
+    {
+        assert(granularity > 0 && granularity <= capacity);
+
+        if (used == 0)
+        {
+            head = 0;
+            tail = 0;
+        }
+
+        VkDeviceSize available = used == 0 ? capacity : (head > tail ? capacity - head : tail - head);
+
+        // Too little left before the end, continue at the start and free the skipped bytes along with this ticket.
+        if (available < granularity && head > tail)
+        {
+            if (tail < granularity)
+            {
+                return {};
+            }
+            Commit(capacity - head, ticket);
+            head      = 0;
+            available = tail;
+        }
+
+        if (available < granularity)
+        {
+            return {};
+        }
+
+        VkDeviceSize allocationSize = std::min(size, available);
+        if (allocationSize < size)
+        {
+            allocationSize -= allocationSize % granularity;
+        }
+
+        // Region boundaries stay aligned, so the aligned end never runs into the tail or past the end.
+        const VkDeviceSize offset = head;
+        const VkDeviceSize end    = (head + allocationSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        Commit(end - head, ticket);
+        head = end;
+
+        StagingAllocation allocation;
+        allocation.buffer = buffer.buffer;
+        allocation.offset = offset;
+        allocation.size   = allocationSize;
+        allocation.data   = static_cast<char*>(buffer.allocationInfo.pMappedData) + offset;
+        return allocation;
+    }
+
+    void StagingRing::Retire(UploadTicket completed)
+    {
+        while (!regions.empty() && regions.front().ticket <= completed)
+        {
+            used -= regions.front().size;
+            tail  = (tail + regions.front().size) % capacity;
+            regions.pop_front();
+        }
+    }
+
+    void StagingRing::Commit(VkDeviceSize size, UploadTicket ticket)
+    {
+        used += size;
+        if (!regions.empty() && regions.back().ticket == ticket)
+        {
+            regions.back().size += size;
+        }
+        else
+        {
+            regions.push_back({ticket, size});
+        }
+    }
+} // namespace lumina
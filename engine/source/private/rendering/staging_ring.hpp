@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include "vk_types.hpp"
+
+#include <deque>
+
+namespace lumina
+{
+    // Contiguous range of the staging ring, valid until the upload batch it was allocated for has completed.
+    struct StagingAllocation
+    {
+        VkBuffer buffer {VK_NULL_HANDLE};
+        VkDeviceSize offset {0};
+        VkDeviceSize size {0};
+        void* data {nullptr};
+    };
+
+    /**
+     * Persistently mapped ring buffer that every upload copies its data through.
+     * Allocations are tagged with the upload ticket of the batch that reads them and freed in order once that ticket has
+     * completed. A request that doesn't fit before the end of the ring is cut short instead of failing, so large uploads are
+     * split across wraps and the ring only runs out when it is genuinely full of data the GPU hasn't copied yet.
+     */
+    class StagingRing
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_CAPACITY = 64 * 1024 * 1024;
+        static constexpr VkDeviceSize ALIGNMENT        = 16;
+
+        void Init(VmaAllocator allocator, VkDeviceSize ringCapacity);
+        void Cleanup(VmaAllocator allocator);
+
+        // Up to size bytes, cut to a multiple of granularity when less is available. Returns an empty allocation when not even
+        // granularity bytes are free.
+        StagingAllocation Allocate(VkDeviceSize size, VkDeviceSize granularity, UploadTicket ticket);
+
+        // Frees everything allocated for tickets up to completed.
+        void Retire(UploadTicket completed);
+
+        [[nodiscard]] UploadTicket OldestTicket() const
+        {
+            return regions.front().ticket;
+        }
+
+        [[nodiscard]] VkDeviceSize Capacity() const
+        {
+            return capacity;
+        }
+
+    private:
+        // Allocations of one ticket, including the padding skipped at the end of the ring.
+        struct Region
+        {
+            UploadTicket ticket;
+            VkDeviceSize size;
+        };
+
+        void Commit(VkDeviceSize size, UploadTicket ticket);
+
+        AllocatedBuffer buffer {};
+        VkDeviceSize capacity {0};
+        VkDeviceSize head {0};
+        VkDeviceSize tail {0};
+        VkDeviceSize used {0};
+        std::deque<Region> regions;
+    };
+} // namespace lumina
@@ -0,0 +1,113 @@
+﻿#include "transform_hierarchy.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace lumina
+{
+    uint32_t TransformHierarchy::AddNode(uint32_t parent, const AffineTransform& localTransform)
+    {
+        const auto index = static_cast<uint32_t>(parents.size());
+        assert(parent == NO_PARENT || (parent < index && subtreeEnds[parent] == index));
+
+        parents.push_back(parent);
+        subtreeEnds.push_back(index + 1);
+        localTransforms.push_back(localTransform);
+        worldTransforms.push_back(localTransform);
+        dirtyFlags.push_back(0);
+
+        for (uint32_t ancestor = parent; ancestor != NO_PARENT; ancestor = parents[ancestor])
+        {
+            subtreeEnds[ancestor] = index + 1;
+        }
+
+        MarkDirty(index);
+        return index;
+    }
+
+    void TransformHierarchy::SetLocalTransform(uint32_t index, const AffineTransform& localTransform)
+    {
+        localTransforms[index] = localTransform;
+        MarkDirty(index);
+    }
+
+    void TransformHierarchy::MarkDirty(uint32_t index)
+    {
+        if (!dirtyFlags[index])
+        {
+            dirtyFlags[index] = 1;
+            dirtyNodes.push_back(index);
+        }
+    }
+
+    void TransformHierarchy::UpdateWorldTransforms(const AffineTransform& rootMatrix)
+    {
+        changedNodes.clear();
+
+        if (rootMatrix != lastRootMatrix)
+        {
+            lastRootMatrix = rootMatrix;
+            for (uint32_t root = 0; root < parents.size(); root = subtreeEnds[root])
+            {
+                MarkDirty(root);
+            }
+        }
+
+        if (dirtyNodes.empty())
+        {
+            return;
+        }
+
+        std::sort(dirtyNodes.begin(), dirtyNodes.end());
+
+        uint32_t processedEnd = 0;
+        for (const uint32_t start : dirtyNodes)
+        {
+            dirtyFlags[start] = 0;
+
+            // Already recomputed as part of a dirty ancestor's subtree.
+            if (start < processedEnd)
+            {
+                continue;
+            }
+
+            const uint32_t end = subtreeEnds[start];
+            for (uint32_t i = start; i < end; i++)
+            {
+                const uint32_t parent = parents[i];
+                if (parent == NO_PARENT)
+                {
+                    worldTransforms[i] = rootMatrix * localTransforms[i];
+                }
+                else
+                {
+                    worldTransforms[i] = worldTransforms[parent] * localTransforms[i];
+                }
+                changedNodes.push_back(i);
+            }
+            processedEnd = end;
+        }
+        dirtyNodes.clear();
+    }
+
+    void TransformHierarchy::Clear()
+    {
+        parents.clear();
+        subtreeEnds.clear();
+        localTransforms.clear();
+        worldTransforms.clear();
+        changedNodes.clear();
+        dirtyFlags.clear();
+        dirtyNodes.clear();
+        lastRootMatrix = AffineTransform::Identity();
+    }
+
+    void TransformHierarchy::Reserve(size_t count)
+    {
+        parents.reserve(count);
+        subtreeEnds.reserve(count);
+        localTransforms.reserve(count);
+        worldTransforms.reserve(count);
+        dirtyFlags.reserve(count);
+    }
+} // namespace lumina
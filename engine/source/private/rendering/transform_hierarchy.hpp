@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include "core/affine_transform.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace lumina
+{
+    /**
+     * Flat, index based storage for a transform tree.
+     * Nodes are stored depth first, so every parent comes before its children and every subtree is one contiguous range.
+     * This allows world transforms to be resolved with linear passes over contiguous arrays instead of a recursive walk over Node::children.
+     *
+     * Changes are tracked with dirty flags: SetLocalTransform marks a node, and UpdateWorldTransforms only re-propagates the subtrees
+     * below marked nodes. A static hierarchy costs nothing beyond a single comparison of the root matrix per update.
+     */
+    struct TransformHierarchy
+    {
+        static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> subtreeEnds;
+        std::vector<AffineTransform> localTransforms;
+        std::vector<AffineTransform> worldTransforms;
+
+        // Nodes whose world transform was recomputed by the last UpdateWorldTransforms call, in ascending order.
+        std::vector<uint32_t> changedNodes;
+
+        // Nodes must be added in depth first pre-order: the parent has to be the most recently added node or one of its ancestors.
+        uint32_t AddNode(uint32_t parent, const AffineTransform& localTransform);
+        void SetLocalTransform(uint32_t index, const AffineTransform& localTransform);
+        void UpdateWorldTransforms(const AffineTransform& rootMatrix = AffineTransform::Identity());
+
+        void Clear();
+        void Reserve(size_t count);
+
+        [[nodiscard]] size_t Size() const
+        {
+            return parents.size();
+        }
+
+        [[nodiscard]] bool IsDirty() const
+        {
+            return !dirtyNodes.empty();
+        }
+
+    private:
+        void MarkDirty(uint32_t index);
+
+        std::vector<uint8_t> dirtyFlags;
+        std::vector<uint32_t> dirtyNodes;
+        AffineTransform lastRootMatrix {};
+    };
+} // namespace lumina
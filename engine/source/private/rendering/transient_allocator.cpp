@@ -0,0 +1,90 @@
+﻿#include "transient_allocator.hpp"
+
+#include "vk_buffer_utils.hpp"
+
+#include <algorithm>
+
+namespace lumina
+{
+    namespace
+    {
+        VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    } // namespace
+
+    void TransientAllocator::Init(VkDevice logicalDevice, VmaAllocator allocator, VkDeviceSize capacity, VkDeviceSize requiredAlignment)
+    {
+        device       = logicalDevice;
+        minAlignment = std::max<VkDeviceSize>(requiredAlignment, 16);
+
+        blocks.push_back(CreateBlock(allocator, capacity));
+    }
+
+    void TransientAllocator::Cleanup(VmaAllocator allocator)
+    {
+        for (const Block& block : blocks)
+        {
+            DestroyBuffer(allocator, block.buffer);
+        }
+        blocks.clear();
+    }
+
+    void TransientAllocator::Reset(VmaAllocator allocator)
+    {
+        // Grow to what the last frame needed, so overflowing stays a one time cost.
+        if (blocks.size() > 1)
+        {
+            const VkDeviceSize capacity = std::max(blocks.front().capacity, usedThisFrame + usedThisFrame / 2);
+            Cleanup(allocator);
+            blocks.push_back(CreateBlock(allocator, capacity));
+        }
+
+        offset        = 0;
+        usedThisFrame = 0;
+    }
+
+    TransientAllocation TransientAllocator::Allocate(VmaAllocator allocator, VkDeviceSize size, VkDeviceSize alignment)
+    {
+        alignment = std::max(alignment, minAlignment);
+
+        VkDeviceSize alignedOffset = AlignUp(offset, alignment);
+        if (alignedOffset + size > blocks.back().capacity)
+        {
+            blocks.push_back(CreateBlock(allocator, std::max(size, blocks.front().capacity)));
+            alignedOffset = 0;
+        }
+
+        usedThisFrame += size + (alignedOffset > offset ? alignedOffset - offset : 0);
+        offset         = alignedOffset + size;
+
+        const Block& block = blocks.back();
+
+        TransientAllocation allocation;
+        allocation.buffer  = block.buffer.buffer;
+        allocation.offset  = alignedOffset;
+        allocation.address = block.address + alignedOffset;
+        allocation.data    = static_cast<char*>(block.buffer.allocationInfo.pMappedData) + alignedOffset;
+        return allocation;
+    }
+
+    TransientAllocator::Block TransientAllocator::CreateBlock(VmaAllocator allocator, VkDeviceSize capacity) const
+    {
+        Block block;
+        block.capacity = capacity;
+        block.buffer   = CreateBuffer(
+            allocator,
+            capacity,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU,
+            MemoryCategory::PerFrame);
+
+        VkBufferDeviceAddressInfo addressInfo {};
+        addressInfo.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = block.buffer.buffer;
+
+        block.address = vkGetBufferDeviceAddress(device, &addressInfo);
+        return block;
+    }
+} // namespace lumina
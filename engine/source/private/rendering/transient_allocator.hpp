@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    // A suballocated range of a transient buffer, valid until the frame it was allocated in is reset.
+    struct TransientAllocation
+    {
+        VkBuffer buffer {VK_NULL_HANDLE};
+        VkDeviceSize offset {0};
+        VkDeviceAddress address {0};
+        void* data {nullptr};
+    };
+
+    /**
+     * Persistently mapped linear allocator for data that only lives for one frame, one per FrameData.
+     * Allocations bump an offset into a single buffer and Reset rewinds it once the fence of the frame has signaled, so the
+     * steady state costs no VMA calls at all. A frame that runs out of space continues in an overflow buffer, after which the
+     * next Reset replaces everything with one buffer large enough for the whole frame.
+     */
+    class TransientAllocator
+    {
+    public:
+        static constexpr VkDeviceSize DEFAULT_CAPACITY = 4 * 1024 * 1024;
+
+        // Every allocation is aligned to at least requiredAlignment, which should cover the offset alignment of uniform and storage buffers.
+        void Init(VkDevice logicalDevice, VmaAllocator allocator, VkDeviceSize capacity, VkDeviceSize requiredAlignment);
+        void Cleanup(VmaAllocator allocator);
+
+        // Only call once the GPU is done with every allocation of the frame.
+        void Reset(VmaAllocator allocator);
+
+        TransientAllocation Allocate(VmaAllocator allocator, VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    private:
+        struct Block
+        {
+            AllocatedBuffer buffer {};
+            VkDeviceAddress address {0};
+            VkDeviceSize capacity {0};
+        };
+
+        Block CreateBlock(VmaAllocator allocator, VkDeviceSize capacity) const;
+
+        VkDevice device {VK_NULL_HANDLE};
+        VkDeviceSize minAlignment {1};
+
+        // The first block is the ring itself, any further ones are overflow of the current frame.
+        std::vector<Block> blocks;
+        VkDeviceSize offset {0};
+        VkDeviceSize usedThisFrame {0};
+    };
+} // namespace lumina
@@ -0,0 +1,417 @@
+﻿#include "upload_queue.hpp"
+
+#include "vk_initializers.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace lumina
+{
+    void UploadQueue::Init(
+        VkDevice logicalDevice,
+        VmaAllocator vmaAllocator,
+        VkQueue transfer,
+        uint32_t transferQueueFamily,
+        VkQueue graphics,
+        uint32_t graphicsQueueFamily)
+    {
+        device         = logicalDevice;
+        allocator      = vmaAllocator;
+        transferQueue  = transfer;
+        transferFamily = transferQueueFamily;
+        graphicsQueue  = graphics;
+        graphicsFamily = graphicsQueueFamily;
+
+        VkSemaphoreTypeCreateInfo typeInfo {};
+        typeInfo.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue  = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = vkinit::SemaphoreCreateInfo();
+        semaphoreInfo.pNext                 = &typeInfo;
+        VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore));
+
+        stagingRing.Init(allocator, StagingRing::DEFAULT_CAPACITY);
+
+        if (HasDedicatedQueue())
+        {
+            Log::Info("Uploading on dedicated transfer queue family {}", transferFamily);
+        }
+    }
+
+    void UploadQueue::Cleanup()
+    {
+        Wait(lastSubmitted);
+
+        for (Batch& batch : batches)
+        {
+            vkDestroyCommandPool(device, batch.transferPool, nullptr);
+            if (batch.graphicsPool != batch.transferPool)
+            {
+                vkDestroyCommandPool(device, batch.graphicsPool, nullptr);
+            }
+        }
+        batches.clear();
+        openBatch = NO_BATCH;
+
+        vkDestroySemaphore(device, semaphore, nullptr);
+        stagingRing.Cleanup(allocator);
+    }
+
+    VkCommandBuffer UploadQueue::TransferCommands()
+    {
+        return OpenBatch().transferCommands;
+    }
+
+    VkCommandBuffer UploadQueue::GraphicsCommands()
+    {
+        Batch& batch = OpenBatch();
+        if (HasDedicatedQueue() && !batch.graphicsRecorded)
+        {
+            const VkCommandBufferBeginInfo beginInfo = vkinit::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+            VK_CHECK(vkBeginCommandBuffer(batch.graphicsCommands, &beginInfo));
+            batch.graphicsRecorded = true;
+        }
+        return batch.graphicsCommands;
+    }
+
+    void UploadQueue::UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        const auto* bytes = static_cast<const char*>(data);
+        for (VkDeviceSize copied = 0; copied < size;)
+        {
+            const StagingAllocation staging = AllocateStaging(size - copied, 1);
+            memcpy(staging.data, bytes + copied, staging.size);
+
+            VkBufferCopy copy {};
+            copy.srcOffset = staging.offset;
+            copy.dstOffset = offset + copied;
+            copy.size      = staging.size;
+
+            vkCmdCopyBuffer(TransferCommands(), staging.buffer, buffer, 1, &copy);
+            copied += staging.size;
+        }
+
+        TransferOwnership(buffer, offset, size);
+    }
+
+    void UploadQueue::UploadImages(tcb::span<const ImageUpload> images)
+    {
+        if (images.empty())
+        {
+            return;
+        }
+
+        std::vector<VkImage> handles;
+        handles.reserve(images.size());
+
+        std::vector<VkImageMemoryBarrier2> imageBarriers;
+        imageBarriers.reserve(images.size());
+
+        for (const ImageUpload& upload : images)
+        {
+            assert(upload.extent.depth == 1);
+            handles.push_back(upload.image);
+
+            VkImageMemoryBarrier2 imageBarrier {};
+            imageBarrier.sType            = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            imageBarrier.srcStageMask     = VK_PIPELINE_STAGE_2_NONE;
+            imageBarrier.srcAccessMask    = VK_ACCESS_2_NONE;
+            imageBarrier.dstStageMask     = VK_PIPELINE_STAGE_2_COPY_BIT;
+            imageBarrier.dstAccessMask    = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            imageBarrier.oldLayout        = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageBarrier.newLayout        = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            imageBarrier.image            = upload.image;
+            imageBarrier.subresourceRange = vkinit::ImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+            imageBarriers.push_back(imageBarrier);
+        }
+
+        VkDependencyInfo dependencyInfo {};
+        dependencyInfo.sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        dependencyInfo.pImageMemoryBarriers    = imageBarriers.data();
+        vkCmdPipelineBarrier2(TransferCommands(), &dependencyInfo);
+
+        for (const ImageUpload& upload : images)
+        {
+            // Images that don't fit the ring at once are copied in bands of whole rows.
+            const VkDeviceSize rowPitch = static_cast<VkDeviceSize>(upload.extent.width) * upload.texelSize;
+            const auto* bytes           = static_cast<const char*>(upload.data);
+            for (uint32_t row = 0; row < upload.extent.height;)
+            {
+                const StagingAllocation staging = AllocateStaging((upload.extent.height - row) * rowPitch, rowPitch);
+                const auto rowCount             = static_cast<uint32_t>(staging.size / rowPitch);
+                memcpy(staging.data, bytes + row * rowPitch, staging.size);
+
+                VkBufferImageCopy copyRegion {};
+                copyRegion.bufferOffset      = staging.offset;
+                copyRegion.bufferRowLength   = 0;
+                copyRegion.bufferImageHeight = 0;
+
+                copyRegion.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                copyRegion.imageSubresource.mipLevel       = 0;
+                copyRegion.imageSubresource.baseArrayLayer = 0;
+                copyRegion.imageSubresource.layerCount     = 1;
+                copyRegion.imageOffset                     = VkOffset3D {0, static_cast<int32_t>(row), 0};
+                copyRegion.imageExtent                     = VkExtent3D {upload.extent.width, rowCount, 1};
+
+                vkCmdCopyBufferToImage(TransferCommands(), staging.buffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+                row += rowCount;
+            }
+        }
+
+        TransferOwnership(handles, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    }
+
+    void UploadQueue::TransferOwnership(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+    {
+        if (!HasDedicatedQueue())
+        {
+            return;
+        }
+
+        VkBufferMemoryBarrier2 release {};
+        release.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        release.srcStageMask        = VK_PIPELINE_STAGE_2_COPY_BIT;
+        release.srcAccessMask       = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        release.srcQueueFamilyIndex = transferFamily;
+        release.dstQueueFamilyIndex = graphicsFamily;
+        release.buffer              = buffer;
+        release.offset              = offset;
+        release.size                = size;
+
+        VkBufferMemoryBarrier2 acquire = release;
+        acquire.srcStageMask           = VK_PIPELINE_STAGE_2_NONE;
+        acquire.srcAccessMask          = VK_ACCESS_2_NONE;
+        acquire.dstStageMask           = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        acquire.dstAccessMask          = VK_ACCESS_2_MEMORY_READ_BIT;
+
+        VkDependencyInfo dependencyInfo {};
+        dependencyInfo.sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.bufferMemoryBarrierCount = 1;
+
+        dependencyInfo.pBufferMemoryBarriers = &release;
+        vkCmdPipelineBarrier2(TransferCommands(), &dependencyInfo);
+
+        dependencyInfo.pBufferMemoryBarriers = &acquire;
+        vkCmdPipelineBarrier2(GraphicsCommands(), &dependencyInfo);
+    }
+
+    void UploadQueue::TransferOwnership(tcb::span<const VkImage> images, VkImageLayout layout)
+    {
+        if (!HasDedicatedQueue() || images.empty())
+        {
+            return;
+        }
+
+        std::vector<VkImageMemoryBarrier2> releases;
+        std::vector<VkImageMemoryBarrier2> acquires;
+        releases.reserve(images.size());
+        acquires.reserve(images.size());
+
+        for (const VkImage image : images)
+        {
+            VkImageMemoryBarrier2 release {};
+            release.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            release.srcStageMask        = VK_PIPELINE_STAGE_2_COPY_BIT;
+            release.srcAccessMask       = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            release.oldLayout           = layout;
+            release.newLayout           = layout;
+            release.srcQueueFamilyIndex = transferFamily;
+            release.dstQueueFamilyIndex = graphicsFamily;
+            release.image               = image;
+            release.subresourceRange    = vkinit::ImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+            releases.push_back(release);
+
+            VkImageMemoryBarrier2 acquire = release;
+            acquire.srcStageMask          = VK_PIPELINE_STAGE_2_NONE;
+            acquire.srcAccessMask         = VK_ACCESS_2_NONE;
+            acquire.dstStageMask          = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            acquire.dstAccessMask         = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+            acquires.push_back(acquire);
+        }
+
+        VkDependencyInfo dependencyInfo {};
+        dependencyInfo.sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(images.size());
+
+        dependencyInfo.pImageMemoryBarriers = releases.data();
+        vkCmdPipelineBarrier2(TransferCommands(), &dependencyInfo);
+
+        dependencyInfo.pImageMemoryBarriers = acquires.data();
+        vkCmdPipelineBarrier2(GraphicsCommands(), &dependencyInfo);
+    }
+
+    UploadTicket UploadQueue::EndUpload()
+    {
+        if (openBatch == NO_BATCH)
+        {
+            return lastSubmitted;
+        }
+
+        // Submitting early lets the GPU start copying while the rest of the ring is being filled.
+        const Batch& batch        = batches[openBatch];
+        const UploadTicket ticket = batch.ticket;
+        if (batch.stagingSize >= stagingRing.Capacity() / 4)
+        {
+            Flush();
+        }
+        return ticket;
+    }
+
+    UploadTicket UploadQueue::Flush()
+    {
+        if (openBatch == NO_BATCH)
+        {
+            return lastSubmitted;
+        }
+
+        Batch& batch = batches[openBatch];
+        openBatch    = NO_BATCH;
+
+        VK_CHECK(vkEndCommandBuffer(batch.transferCommands));
+
+        // Both queues signal the same timeline, which has to grow monotonically. Waiting for the previous batch to finish keeps the
+        // transfer half from signalling before the graphics half of that batch.
+        const VkCommandBufferSubmitInfo transferInfo = vkinit::CommandBufferSubmitInfo(batch.transferCommands);
+        VkSemaphoreSubmitInfo transferWait           = vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, semaphore);
+        transferWait.value                           = lastSubmitted;
+        VkSemaphoreSubmitInfo transferSignal         = vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, semaphore);
+        transferSignal.value                         = batch.graphicsRecorded ? batch.ticket - 1 : batch.ticket;
+
+        const VkSubmitInfo2 transferSubmit = vkinit::SubmitInfo(&transferInfo, &transferSignal, &transferWait);
+        VK_CHECK(vkQueueSubmit2(transferQueue, 1, &transferSubmit, VK_NULL_HANDLE));
+
+        if (batch.graphicsRecorded)
+        {
+            VK_CHECK(vkEndCommandBuffer(batch.graphicsCommands));
+
+            const VkCommandBufferSubmitInfo graphicsInfo = vkinit::CommandBufferSubmitInfo(batch.graphicsCommands);
+            VkSemaphoreSubmitInfo graphicsWait           = vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, semaphore);
+            graphicsWait.value                           = batch.ticket - 1;
+            VkSemaphoreSubmitInfo graphicsSignal         = vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, semaphore);
+            graphicsSignal.value                         = batch.ticket;
+
+            const VkSubmitInfo2 graphicsSubmit = vkinit::SubmitInfo(&graphicsInfo, &graphicsSignal, &graphicsWait);
+            VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &graphicsSubmit, VK_NULL_HANDLE));
+        }
+
+        lastSubmitted = batch.ticket;
+        return lastSubmitted;
+    }
+
+    bool UploadQueue::IsComplete(UploadTicket ticket) const
+    {
+        uint64_t completed = 0;
+        VK_CHECK(vkGetSemaphoreCounterValue(device, semaphore, &completed));
+        return completed >= ticket;
+    }
+
+    void UploadQueue::Wait(UploadTicket ticket)
+    {
+        if (ticket > lastSubmitted)
+        {
+            Flush();
+        }
+
+        VkSemaphoreWaitInfo waitInfo {};
+        waitInfo.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores    = &semaphore;
+        waitInfo.pValues        = &ticket;
+        VK_CHECK(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+    }
+
+    UploadQueue::Batch& UploadQueue::OpenBatch()
+    {
+        if (openBatch != NO_BATCH)
+        {
+            return batches[openBatch];
+        }
+
+        uint64_t completed = 0;
+        VK_CHECK(vkGetSemaphoreCounterValue(device, semaphore, &completed));
+
+        for (uint32_t i = 0; i < batches.size(); i++)
+        {
+            if (batches[i].ticket <= completed)
+            {
+                openBatch = i;
+                break;
+            }
+        }
+
+        if (openBatch == NO_BATCH)
+        {
+            batches.push_back(CreateBatch());
+            openBatch = static_cast<uint32_t>(batches.size()) - 1;
+        }
+
+        Batch& batch = batches[openBatch];
+        VK_CHECK(vkResetCommandPool(device, batch.transferPool, 0));
+        if (batch.graphicsPool != batch.transferPool)
+        {
+            VK_CHECK(vkResetCommandPool(device, batch.graphicsPool, 0));
+        }
+        batch.graphicsRecorded = false;
+        batch.ticket           = lastSubmitted + 2;
+        batch.stagingSize      = 0;
+
+        const VkCommandBufferBeginInfo beginInfo = vkinit::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        VK_CHECK(vkBeginCommandBuffer(batch.transferCommands, &beginInfo));
+
+        return batch;
+    }
+
+    UploadQueue::Batch UploadQueue::CreateBatch() const
+    {
+        Batch batch;
+
+        const VkCommandPoolCreateInfo transferPoolInfo = vkinit::CommandPoolCreateInfo(transferFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        VK_CHECK(vkCreateCommandPool(device, &transferPoolInfo, nullptr, &batch.transferPool));
+
+        const VkCommandBufferAllocateInfo transferAllocateInfo = vkinit::CommandBufferAllocateInfo(batch.transferPool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(device, &transferAllocateInfo, &batch.transferCommands));
+
+        if (HasDedicatedQueue())
+        {
+            const VkCommandPoolCreateInfo graphicsPoolInfo = vkinit::CommandPoolCreateInfo(graphicsFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            VK_CHECK(vkCreateCommandPool(device, &graphicsPoolInfo, nullptr, &batch.graphicsPool));
+
+            const VkCommandBufferAllocateInfo graphicsAllocateInfo = vkinit::CommandBufferAllocateInfo(batch.graphicsPool, 1);
+            VK_CHECK(vkAllocateCommandBuffers(device, &graphicsAllocateInfo, &batch.graphicsCommands));
+        }
+        else
+        {
+            batch.graphicsPool     = batch.transferPool;
+            batch.graphicsCommands = batch.transferCommands;
+        }
+        return batch;
+    }
+
+    StagingAllocation UploadQueue::AllocateStaging(VkDeviceSize size, VkDeviceSize granularity)
+    {
+        for (;;)
+        {
+            uint64_t completed = 0;
+            VK_CHECK(vkGetSemaphoreCounterValue(device, semaphore, &completed));
+            stagingRing.Retire(completed);
+
+            Batch& batch                       = OpenBatch();
+            const StagingAllocation allocation = stagingRing.Allocate(size, granularity, batch.ticket);
+            if (allocation.size > 0)
+            {
+                batch.stagingSize += allocation.size;
+                return allocation;
+            }
+
+            // Submits the open batch first when it is the one holding the oldest data.
+            Wait(stagingRing.OldestTicket());
+        }
+    }
+} // namespace lumina
@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#include "core/span.hpp"
+#include "staging_ring.hpp"
+#include "vk_types.hpp"
+
+#include <vector>
+
+namespace lumina
+{
+    // Tightly packed texels for mip 0 of a 2D image.
+    struct ImageUpload
+    {
+        VkImage image;
+        VkExtent3D extent;
+        uint32_t texelSize;
+        const void* data;
+    };
+
+    /**
+     * Batches CPU to GPU copies into as few submissions as possible, on a dedicated transfer queue when the device has one.
+     * Data is copied through a StagingRing into the open batch, which is submitted by Flush and signals a timeline semaphore. Every upload
+     * returns the value its batch signals as a ticket, so callers can poll for completion instead of waiting on a fence, and
+     * the renderer makes each frame wait for the last submitted value on the GPU.
+     *
+     * With a separate transfer family, resources are released by the transfer queue and acquired by the graphics queue, which
+     * also runs the work a transfer queue can't do, like mip generation. On single queue devices both halves of a batch are
+     * the same command buffer on the graphics queue. Not thread safe, uploads are recorded from the main thread.
+     */
+    class UploadQueue
+    {
+    public:
+        void Init(
+            VkDevice logicalDevice,
+            VmaAllocator vmaAllocator,
+            VkQueue transfer,
+            uint32_t transferQueueFamily,
+            VkQueue graphics,
+            uint32_t graphicsQueueFamily);
+        void Cleanup();
+
+        // Copies of the open batch, recorded on the transfer queue.
+        VkCommandBuffer TransferCommands();
+        // Work of the open batch that needs the graphics queue, runs after every copy of the batch.
+        VkCommandBuffer GraphicsCommands();
+
+        // Copies data into the buffer, in several pieces when it doesn't fit the staging ring at once.
+        void UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+        // Fills mip 0 of every image, which end up in TRANSFER_DST_OPTIMAL. Layout transitions and ownership transfers of all
+        // images share their barriers.
+        void UploadImages(tcb::span<const ImageUpload> images);
+
+        // Hands a range written by the transfer commands over to the graphics queue, nothing to do on a single queue.
+        void TransferOwnership(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+        // The images have to be in layout when the transfer commands are done and stay in it.
+        void TransferOwnership(tcb::span<const VkImage> images, VkImageLayout layout);
+
+        // Ends an upload and returns its ticket. Batches that hold a large part of the staging ring are submitted right away.
+        UploadTicket EndUpload();
+
+        // Submits the open batch, returns the ticket of the last submitted batch.
+        UploadTicket Flush();
+
+        [[nodiscard]] bool IsComplete(UploadTicket ticket) const;
+        void Wait(UploadTicket ticket);
+
+        [[nodiscard]] bool HasDedicatedQueue() const
+        {
+            return transferFamily != graphicsFamily;
+        }
+
+        [[nodiscard]] VkSemaphore Semaphore() const
+        {
+            return semaphore;
+        }
+
+        // Value the graphics queue has to wait for before using anything uploaded so far.
+        [[nodiscard]] UploadTicket LastSubmitted() const
+        {
+            return lastSubmitted;
+        }
+
+    private:
+        static constexpr uint32_t NO_BATCH = UINT32_MAX;
+
+        struct Batch
+        {
+            VkCommandPool transferPool {VK_NULL_HANDLE};
+            VkCommandPool graphicsPool {VK_NULL_HANDLE};
+            VkCommandBuffer transferCommands {VK_NULL_HANDLE};
+            VkCommandBuffer graphicsCommands {VK_NULL_HANDLE};
+            bool graphicsRecorded {false};
+
+            // The transfer half signals ticket - 1 for the graphics half to wait on, the whole batch is done at ticket.
+            UploadTicket ticket {0};
+            VkDeviceSize stagingSize {0};
+        };
+
+        Batch& OpenBatch();
+        Batch CreateBatch() const;
+        // Waits for the GPU only when the ring is full of data it hasn't copied yet.
+        StagingAllocation AllocateStaging(VkDeviceSize size, VkDeviceSize granularity);
+
+        VkDevice device {VK_NULL_HANDLE};
+        VmaAllocator allocator {VK_NULL_HANDLE};
+        VkQueue transferQueue {VK_NULL_HANDLE};
+        VkQueue graphicsQueue {VK_NULL_HANDLE};
+        uint32_t transferFamily {0};
+        uint32_t graphicsFamily {0};
+
+        VkSemaphore semaphore {VK_NULL_HANDLE};
+        UploadTicket lastSubmitted {0};
+
+        StagingRing stagingRing;
+
+        std::vector<Batch> batches;
+        uint32_t openBatch {NO_BATCH};
+    };
+} // namespace lumina
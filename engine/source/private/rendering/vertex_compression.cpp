@@ -0,0 +1,61 @@
+﻿#include "vertex_compression.hpp"
+
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace lumina
+{
+    namespace
+    {
+        float2 SignNotZero(const float2& value)
+        {
+            return float2 {value.x >= 0.0f ? 1.0f : -1.0f, value.y >= 0.0f ? 1.0f : -1.0f};
+        }
+    } // namespace
+
+    float2 EncodeOctahedral(const float3& normal)
+    {
+        const float length = glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+        if (length == 0.0f)
+        {
+            return float2 {0.0f};
+        }
+
+        float2 encoded = float2 {normal.x, normal.y} / length;
+        if (normal.z < 0.0f)
+        {
+            encoded = (1.0f - glm::abs(float2 {encoded.y, encoded.x})) * SignNotZero(encoded);
+        }
+        return encoded;
+    }
+
+    void CompressVertices(tcb::span<const Vertex> vertices, const Bounds& bounds, CompactVertex* out)
+    {
+        // A flat surface has no extent along one axis, every position decodes to the origin along it.
+        const float3 minimum = bounds.origin - bounds.extents;
+        const float3 size    = bounds.extents * 2.0f;
+
+        float3 scale {0.0f};
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (size[axis] > 0.0f)
+            {
+                scale[axis] = 1.0f / size[axis];
+            }
+        }
+
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const Vertex& vertex = vertices[i];
+
+            const float3 position = glm::clamp((vertex.position - minimum) * scale, 0.0f, 1.0f);
+            const float2 normal   = EncodeOctahedral(vertex.normal);
+
+            CompactVertex& compact  = out[i];
+            compact.positionXY      = glm::packUnorm2x16(float2 {position.x, position.y});
+            compact.positionZNormal = glm::packUnorm1x16(position.z) | static_cast<uint32_t>(glm::packSnorm2x8(normal)) << 16;
+            compact.uv              = glm::packHalf2x16(float2 {vertex.uv_x, vertex.uv_y});
+            compact.color           = glm::packUnorm4x8(glm::clamp(vertex.color, 0.0f, 1.0f));
+        }
+    }
+} // namespace lumina
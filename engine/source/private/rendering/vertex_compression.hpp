@@ -0,0 +1,13 @@
+﻿#pragma once
+
+#include "core/span.hpp"
+#include "vk_types.hpp"
+
+namespace lumina
+{
+    // Maps a unit vector onto the [-1, 1] square of an octahedron unfolded along z.
+    float2 EncodeOctahedral(const float3& normal);
+
+    // Quantizes vertices of a single surface, bounds has to enclose every position. out must hold vertices.size() entries.
+    void CompressVertices(tcb::span<const Vertex> vertices, const Bounds& bounds, CompactVertex* out);
+} // namespace lumina
@@ -2,7 +2,12 @@
 
 namespace lumina
 {
-    AllocatedBuffer CreateBuffer(const VmaAllocator allocator, const size_t allocSize, const VkBufferUsageFlags usage, const VmaMemoryUsage memoryUsage)
+    AllocatedBuffer CreateBuffer(
+        const VmaAllocator allocator,
+        const size_t allocSize,
+        const VkBufferUsageFlags usage,
+        const VmaMemoryUsage memoryUsage,
+        const MemoryCategory category)
     {
         VkBufferCreateInfo bufferInfo {};
         bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -16,12 +21,14 @@ namespace lumina
         AllocatedBuffer newBuffer;
 
         VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &newBuffer.buffer, &newBuffer.allocation, &newBuffer.allocationInfo));
+        GPUMemory::Track(allocator, newBuffer.allocation, category);
 
         return newBuffer;
     }
 
     void DestroyBuffer(const VmaAllocator allocator, const AllocatedBuffer& buffer)
     {
+        GPUMemory::Untrack(allocator, buffer.allocation);
         vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
     }
 } // namespace lumina
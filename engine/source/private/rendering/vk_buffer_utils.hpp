@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include "gpu_memory.hpp"
 #include "vk_types.hpp"
 
 #include <vma/vk_mem_alloc.h>
@@ -6,6 +7,6 @@
 
 namespace lumina
 {
-    AllocatedBuffer CreateBuffer(VmaAllocator allocator, size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+    AllocatedBuffer CreateBuffer(VmaAllocator allocator, size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, MemoryCategory category);
     void DestroyBuffer(VmaAllocator allocator, const AllocatedBuffer& buffer);
 }; // namespace lumina
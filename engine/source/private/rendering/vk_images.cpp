@@ -2,6 +2,9 @@
 
 #include "vk_initializers.hpp"
 
+#include <algorithm>
+#include <vector>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image/stb_image.h>
 
@@ -76,51 +79,82 @@ namespace lumina
 
     void vkutil::GenerateMipMaps(VkCommandBuffer command, VkImage image, VkExtent2D imageSize)
     {
-        int mipLevels = static_cast<int>(std::floor(std::log2(std::max(imageSize.width, imageSize.height)))) + 1;
-        for (int mip = 0; mip < mipLevels; mip++)
+        GenerateMipMaps(command, tcb::span<const VkImage>(&image, 1), tcb::span<const VkExtent2D>(&imageSize, 1));
+    }
+
+    void vkutil::GenerateMipMaps(VkCommandBuffer command, tcb::span<const VkImage> images, tcb::span<const VkExtent2D> imageSizes)
+    {
+        std::vector<VkExtent2D> sizes(imageSizes.begin(), imageSizes.end());
+        std::vector<uint32_t> mipLevels(images.size());
+
+        uint32_t maxMipLevels = 0;
+        for (size_t i = 0; i < images.size(); i++)
         {
-            VkExtent2D halfSize = imageSize;
-            halfSize.width /= 2;
-            halfSize.height /= 2;
+            mipLevels[i] = static_cast<uint32_t>(std::floor(std::log2(std::max(sizes[i].width, sizes[i].height)))) + 1;
+            maxMipLevels = std::max(maxMipLevels, mipLevels[i]);
+        }
 
-            VkImageMemoryBarrier2 imageBarrier {};
-            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-            imageBarrier.pNext = nullptr;
+        std::vector<VkImageMemoryBarrier2> imageBarriers;
+        imageBarriers.reserve(images.size());
 
-            imageBarrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-            imageBarrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
-            imageBarrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
-            imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
+        VkDependencyInfo dependencyInfo {};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.pNext = nullptr;
+
+        for (uint32_t mip = 0; mip < maxMipLevels; mip++)
+        {
+            // The level just written becomes the blit source of the next one, for every image that has it in one barrier.
+            imageBarriers.clear();
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                if (mip >= mipLevels[i])
+                {
+                    continue;
+                }
+
+                VkImageMemoryBarrier2 imageBarrier {};
+                imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+                imageBarrier.pNext = nullptr;
 
-            imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+                imageBarrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+                imageBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+                imageBarrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+                imageBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
 
-            VkImageAspectFlags aspectMask              = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageBarrier.subresourceRange              = vkinit::ImageSubresourceRange(aspectMask);
-            imageBarrier.subresourceRange.levelCount   = 1;
-            imageBarrier.subresourceRange.baseMipLevel = mip;
-            imageBarrier.image                         = image;
+                imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
-            VkDependencyInfo dependencyInfo {};
-            dependencyInfo.sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-            dependencyInfo.pNext                   = nullptr;
-            dependencyInfo.imageMemoryBarrierCount = 1;
-            dependencyInfo.pImageMemoryBarriers    = &imageBarrier;
+                imageBarrier.subresourceRange              = vkinit::ImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+                imageBarrier.subresourceRange.levelCount   = 1;
+                imageBarrier.subresourceRange.baseMipLevel = mip;
+                imageBarrier.image                         = images[i];
 
+                imageBarriers.push_back(imageBarrier);
+            }
+
+            dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+            dependencyInfo.pImageMemoryBarriers    = imageBarriers.data();
             vkCmdPipelineBarrier2(command, &dependencyInfo);
 
-            if (mip < mipLevels - 1)
+            for (size_t i = 0; i < images.size(); i++)
             {
+                if (mip + 1 >= mipLevels[i])
+                {
+                    continue;
+                }
+
+                const VkExtent2D halfSize {std::max(sizes[i].width / 2, 1u), std::max(sizes[i].height / 2, 1u)};
+
                 VkImageBlit2 blitRegion {};
                 blitRegion.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
                 blitRegion.pNext = nullptr;
 
-                blitRegion.srcOffsets[1].x = imageSize.width;
-                blitRegion.srcOffsets[1].y = imageSize.height;
+                blitRegion.srcOffsets[1].x = static_cast<int32_t>(sizes[i].width);
+                blitRegion.srcOffsets[1].y = static_cast<int32_t>(sizes[i].height);
                 blitRegion.srcOffsets[1].z = 1;
 
-                blitRegion.dstOffsets[1].x = halfSize.width;
-                blitRegion.dstOffsets[1].y = halfSize.height;
+                blitRegion.dstOffsets[1].x = static_cast<int32_t>(halfSize.width);
+                blitRegion.dstOffsets[1].y = static_cast<int32_t>(halfSize.height);
                 blitRegion.dstOffsets[1].z = 1;
 
                 blitRegion.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -136,9 +170,9 @@ namespace lumina
                 VkBlitImageInfo2 blitInfo {};
                 blitInfo.sType          = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2;
                 blitInfo.pNext          = nullptr;
-                blitInfo.dstImage       = image;
+                blitInfo.dstImage       = images[i];
                 blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                blitInfo.srcImage       = image;
+                blitInfo.srcImage       = images[i];
                 blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
                 blitInfo.filter         = VK_FILTER_LINEAR;
                 blitInfo.regionCount    = 1;
@@ -146,9 +180,33 @@ namespace lumina
 
                 vkCmdBlitImage2(command, &blitInfo);
 
-                imageSize = halfSize;
+                sizes[i] = halfSize;
             }
         }
-        TransitionImage(command, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+        imageBarriers.clear();
+        for (const VkImage image : images)
+        {
+            VkImageMemoryBarrier2 imageBarrier {};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            imageBarrier.pNext = nullptr;
+
+            imageBarrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+            imageBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            imageBarrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            imageBarrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+
+            imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            imageBarrier.subresourceRange = vkinit::ImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+            imageBarrier.image            = image;
+
+            imageBarriers.push_back(imageBarrier);
+        }
+
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        dependencyInfo.pImageMemoryBarriers    = imageBarriers.data();
+        vkCmdPipelineBarrier2(command, &dependencyInfo);
     }
 } // namespace lumina
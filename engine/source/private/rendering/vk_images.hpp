@@ -1,5 +1,7 @@
 #pragma once
 
+#include "core/span.hpp"
+
 #include <vulkan/vulkan.h>
 
 namespace lumina
@@ -10,6 +12,9 @@ namespace lumina
 
         void CopyImageToImage(VkCommandBuffer command, VkImage srcImage, VkImage dstImage, VkExtent2D srcSize, VkExtent2D dstSize);
 
+        // Every level has to be in TRANSFER_DST_OPTIMAL with mip 0 filled in, all of them end up in SHADER_READ_ONLY_OPTIMAL.
         void GenerateMipMaps(VkCommandBuffer command, VkImage image, VkExtent2D imageSize);
+        // Builds the chains of all images level by level, with a single barrier per level shared by every image.
+        void GenerateMipMaps(VkCommandBuffer command, tcb::span<const VkImage> images, tcb::span<const VkExtent2D> imageSizes);
     } // namespace vkutil
 } // namespace lumina
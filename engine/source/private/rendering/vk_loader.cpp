@@ -1,6 +1,9 @@
 ﻿#include "vk_loader.hpp"
 
+#include "mesh_lod.hpp"
+#include "occlusion_culling.hpp"
 #include "stb_image/stb_image.h"
+#include "vertex_compression.hpp"
 #include "vk_buffer_utils.hpp"
 #include "vk_initializers.hpp"
 #include "vk_renderer.hpp"
@@ -14,83 +17,54 @@
 
 namespace lumina
 {
-    std::optional<AllocatedImage> LoadGLTFImage(VulkanRenderer* renderer, fastgltf::Asset& asset, fastgltf::Image& image)
+    // Decodes the image into RGBA8 texels, which are freed with stbi_image_free. Returns nullptr when the image can't be read.
+    unsigned char* DecodeGLTFImage(const fastgltf::Asset& asset, const fastgltf::Image& image, VkExtent3D& size)
     {
-        AllocatedImage newImage {};
+        unsigned char* data = nullptr;
 
         int width, height, nrChannels;
 
         std::visit(
             fastgltf::visitor {
                 [](auto& arg) {},
-                [&](fastgltf::sources::URI& filePath) {
+                [&](const fastgltf::sources::URI& filePath) {
                     assert(filePath.fileByteOffset == 0);
                     assert(filePath.uri.isLocalPath());
 
                     const std::string path(filePath.uri.path().begin(), filePath.uri.path().end());
-                    if (unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4))
-                    {
-                        VkExtent3D imageSize;
-                        imageSize.width  = width;
-                        imageSize.height = height;
-                        imageSize.depth  = 1;
-
-                        newImage = renderer->CreateImage(data, imageSize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
-
-                        stbi_image_free(data);
-                    }
+                    data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
                 },
-                [&](fastgltf::sources::Array& array) {
-                    if (unsigned char* data = stbi_load_from_memory(array.bytes.data(), static_cast<int>(array.bytes.size()), &width, &height, &nrChannels, 4))
-                    {
-                        VkExtent3D imageSize;
-                        imageSize.width  = width;
-                        imageSize.height = height;
-                        imageSize.depth  = 1;
-
-                        newImage = renderer->CreateImage(data, imageSize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
-
-                        stbi_image_free(data);
-                    }
+                [&](const fastgltf::sources::Array& array) {
+                    data = stbi_load_from_memory(array.bytes.data(), static_cast<int>(array.bytes.size()), &width, &height, &nrChannels, 4);
                 },
-                [&](fastgltf::sources::BufferView& view) {
+                [&](const fastgltf::sources::BufferView& view) {
                     auto& bufferView = asset.bufferViews[view.bufferViewIndex];
                     auto& buffer     = asset.buffers[bufferView.bufferIndex];
 
                     std::visit(
                         fastgltf::visitor {
                             [](auto& arg) {},
-                            [&](fastgltf::sources::Array& array) {
-                                if (unsigned char* data = stbi_load_from_memory(
-                                        array.bytes.data() + bufferView.byteOffset,
-                                        static_cast<int>(bufferView.byteLength),
-                                        &width,
-                                        &height,
-                                        &nrChannels,
-                                        4))
-                                {
-                                    VkExtent3D imageSize;
-                                    imageSize.width  = width;
-                                    imageSize.height = height;
-                                    imageSize.depth  = 1;
-
-                                    newImage = renderer->CreateImage(data, imageSize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
-
-                                    stbi_image_free(data);
-                                }
+                            [&](const fastgltf::sources::Array& array) {
+                                data = stbi_load_from_memory(
+                                    array.bytes.data() + bufferView.byteOffset,
+                                    static_cast<int>(bufferView.byteLength),
+                                    &width,
+                                    &height,
+                                    &nrChannels,
+                                    4);
                             }},
                         buffer.data);
                 },
             },
             image.data);
-        if (newImage.image == VK_NULL_HANDLE)
-        {
-            return {};
-        }
-        else
+
+        if (data)
         {
-            return newImage;
+            size.width  = width;
+            size.height = height;
+            size.depth  = 1;
         }
+        return data;
     }
 
     VkFilter ExtractFilter(fastgltf::Filter filter)
@@ -121,25 +95,96 @@ namespace lumina
         }
     }
 
-    void LoadedGLTF::Draw(const glm::mat4& topMatrix, DrawContext& context)
+    void LoadedGLTF::Register(DrawContext& context)
+    {
+        if (drawContext != nullptr)
+        {
+            Unregister(*drawContext);
+        }
+        drawContext = &context;
+
+        for (Node* node : transformNodes)
+        {
+            node->RegisterSelf(context);
+        }
+    }
+
+    void LoadedGLTF::Unregister(DrawContext& context)
     {
-        for (auto& node : topNodes)
+        for (Node* node : transformNodes)
         {
-            node->Draw(topMatrix, context);
+            node->UnregisterSelf(context);
+        }
+        drawContext = nullptr;
+    }
+
+    void LoadedGLTF::BuildTransformHierarchy()
+    {
+        transforms.Clear();
+        transformNodes.clear();
+        transforms.Reserve(nodes.size());
+        transformNodes.reserve(nodes.size());
+
+        // Depth first pre-order, so every parent is added before its children and subtrees end up contiguous.
+        std::vector<std::pair<Node*, uint32_t>> pending;
+        for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it)
+        {
+            pending.emplace_back(it->get(), TransformHierarchy::NO_PARENT);
+        }
+
+        while (!pending.empty())
+        {
+            auto [node, parent] = pending.back();
+            pending.pop_back();
+
+            node->transformIndex = transforms.AddNode(parent, node->localTransform);
+            transformNodes.push_back(node);
+
+            for (auto it = node->children.rbegin(); it != node->children.rend(); ++it)
+            {
+                pending.emplace_back(it->get(), node->transformIndex);
+            }
+        }
+    }
+
+    void LoadedGLTF::SetLocalTransform(Node& node, const AffineTransform& localTransform)
+    {
+        node.localTransform = localTransform;
+        transforms.SetLocalTransform(node.transformIndex, localTransform);
+    }
+
+    void LoadedGLTF::UpdateTransforms(const AffineTransform& topMatrix)
+    {
+        // The cached world transforms already include topMatrix, so only the nodes that actually changed need touching.
+        transforms.UpdateWorldTransforms(topMatrix);
+
+        for (const uint32_t index : transforms.changedNodes)
+        {
+            Node* node           = transformNodes[index];
+            node->worldTransform = transforms.worldTransforms[index];
+
+            if (drawContext != nullptr)
+            {
+                node->OnWorldTransformChanged(*drawContext);
+            }
         }
     }
 
     void LoadedGLTF::ClearAll()
     {
-        VkDevice device = creator->device;
+        if (drawContext != nullptr)
+        {
+            Unregister(*drawContext);
+        }
 
-        descriptorPool.DestroyPool(device);
-        DestroyBuffer(creator->allocator, materialDataBuffer);
+        for (auto& [k, v] : materials)
+        {
+            creator->FreeMaterial(v->data.materialIndex);
+        }
 
         for (auto& [k, v] : meshes)
         {
-            DestroyBuffer(creator->allocator, v->buffers.indexBuffer);
-            DestroyBuffer(creator->allocator, v->buffers.vertexBuffer);
+            creator->FreeMesh(v->buffers);
         }
 
         for (auto& [k, v] : images)
@@ -153,7 +198,7 @@ namespace lumina
 
         for (auto& sampler : samplers)
         {
-            vkDestroySampler(device, sampler, nullptr);
+            creator->DestroySampler(sampler);
         }
     }
 
@@ -210,13 +255,6 @@ namespace lumina
             return {};
         }
 
-        std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> poolSizes = {
-            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3},
-            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
-            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3}};
-
-        file.descriptorPool.InitializePool(renderer->device, gltfAsset.materials.size(), poolSizes);
-
         for (fastgltf::Sampler& sampler : gltfAsset.samplers)
         {
             VkSamplerCreateInfo samplerInfo {};
@@ -239,14 +277,37 @@ namespace lumina
         std::vector<AllocatedImage> images;
         std::vector<std::shared_ptr<GLTFMaterial>> materials;
 
-        for (fastgltf::Image& image : gltfAsset.images)
+        // Images are decoded in parallel and uploaded together, so every copy and mip chain of the file shares one batch.
+        std::vector<unsigned char*> decodedImages(gltfAsset.images.size(), nullptr);
+        std::vector<VkExtent3D> decodedSizes(gltfAsset.images.size());
+        renderer->workerPool.ParallelFor(static_cast<uint32_t>(gltfAsset.images.size()), 1, [&](uint32_t begin, uint32_t end, uint32_t) {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                decodedImages[i] = DecodeGLTFImage(gltfAsset, gltfAsset.images[i], decodedSizes[i]);
+            }
+        });
+
+        std::vector<ImageData> imageData;
+        for (size_t i = 0; i < decodedImages.size(); i++)
         {
-            std::optional<AllocatedImage> img = LoadGLTFImage(renderer, gltfAsset, image);
+            if (decodedImages[i])
+            {
+                imageData.push_back(ImageData {decodedImages[i], decodedSizes[i], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true});
+            }
+        }
+
+        const std::vector<AllocatedImage> uploadedImages = renderer->CreateImages(imageData);
 
-            if (img.has_value())
+        size_t uploadedIndex = 0;
+        for (size_t i = 0; i < decodedImages.size(); i++)
+        {
+            const fastgltf::Image& image = gltfAsset.images[i];
+            if (decodedImages[i])
             {
-                images.push_back(*img);
-                file.images[image.name.c_str()] = *img;
+                const AllocatedImage& img = uploadedImages[uploadedIndex++];
+                images.push_back(img);
+                file.images[image.name.c_str()] = img;
+                stbi_image_free(decodedImages[i]);
             }
             else
             {
@@ -255,31 +316,12 @@ namespace lumina
             }
         }
 
-        file.materialDataBuffer = CreateBuffer(
-            renderer->allocator,
-            sizeof(GLTFMetallicRoughness::MaterialConstants) * gltfAsset.materials.size(),
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VMA_MEMORY_USAGE_CPU_TO_GPU);
-        int dataIndex {0};
-
-        auto sceneMaterialConstants = static_cast<GLTFMetallicRoughness::MaterialConstants*>(file.materialDataBuffer.allocationInfo.pMappedData);
-
         for (fastgltf::Material& material : gltfAsset.materials)
         {
             auto newMaterial = std::make_shared<GLTFMaterial>();
             materials.push_back(newMaterial);
             file.materials[material.name.c_str()] = newMaterial;
 
-            GLTFMetallicRoughness::MaterialConstants constants {};
-            constants.colorFactors.x = material.pbrData.baseColorFactor[0];
-            constants.colorFactors.y = material.pbrData.baseColorFactor[1];
-            constants.colorFactors.z = material.pbrData.baseColorFactor[2];
-            constants.colorFactors.w = material.pbrData.baseColorFactor[3];
-
-            constants.metallicRoughnessFactors.x = material.pbrData.metallicFactor;
-            constants.metallicRoughnessFactors.y = material.pbrData.roughnessFactor;
-            sceneMaterialConstants[dataIndex]    = constants;
-
             auto passType = MaterialPass::MainColor;
             if (material.alphaMode == fastgltf::AlphaMode::Blend)
             {
@@ -292,8 +334,13 @@ namespace lumina
             materialResources.metallicRoughnessImage   = renderer->whiteImage;
             materialResources.metallicRoughnessSampler = renderer->defaultSamplerLinear;
 
-            materialResources.dataBuffer       = file.materialDataBuffer.buffer;
-            materialResources.dataBufferOffset = dataIndex * sizeof(GLTFMetallicRoughness::MaterialConstants);
+            materialResources.colorFactors.x = material.pbrData.baseColorFactor[0];
+            materialResources.colorFactors.y = material.pbrData.baseColorFactor[1];
+            materialResources.colorFactors.z = material.pbrData.baseColorFactor[2];
+            materialResources.colorFactors.w = material.pbrData.baseColorFactor[3];
+
+            materialResources.metallicRoughnessFactors.x = material.pbrData.metallicFactor;
+            materialResources.metallicRoughnessFactors.y = material.pbrData.roughnessFactor;
 
             if (material.pbrData.baseColorTexture.has_value())
             {
@@ -303,12 +350,14 @@ namespace lumina
                 materialResources.colorImage   = images[image];
                 materialResources.colorSampler = file.samplers[sampler];
             }
-            newMaterial->data = renderer->metallicRoughnessMaterial.WriteMaterial(renderer->device, passType, materialResources, file.descriptorPool);
-            dataIndex++;
+            newMaterial->data = renderer->metallicRoughnessMaterial.WriteMaterial(renderer->device, passType, materialResources, renderer->bindlessMaterials);
         }
 
         std::vector<uint32_t> indices;
         std::vector<Vertex> vertices;
+        std::vector<CompactVertex> compactVertices;
+        std::vector<size_t> surfaceVertexBegins;
+        std::vector<float3> positions;
 
         for (fastgltf::Mesh& mesh : gltfAsset.meshes)
         {
@@ -319,6 +368,7 @@ namespace lumina
 
             indices.clear();
             vertices.clear();
+            surfaceVertexBegins.clear();
 
             for (auto&& primitives : mesh.primitives)
             {
@@ -327,6 +377,7 @@ namespace lumina
                 newSurface.indexCount = static_cast<uint32_t>(gltfAsset.accessors[primitives.indicesAccessor.value()].count);
 
                 size_t initialVertex = vertices.size();
+                surfaceVertexBegins.push_back(initialVertex);
 
                 //Load indices
                 {
@@ -406,7 +457,44 @@ namespace lumina
                 newSurface.bounds.sphereRadius = glm::length(newSurface.bounds.extents);
                 newMesh->surfaces.push_back(newSurface);
             }
-            newMesh->buffers = renderer->UploadMesh(indices, vertices);
+            positions.clear();
+            positions.reserve(vertices.size());
+            for (const Vertex& vertex : vertices)
+            {
+                positions.push_back(vertex.position);
+            }
+
+            if (indices.size() / 3 <= MAX_OCCLUDER_TRIANGLES)
+            {
+                newMesh->occluder            = std::make_shared<OccluderGeometry>();
+                newMesh->occluder->indices   = indices;
+                newMesh->occluder->positions = positions;
+            }
+
+            // The simplified levels share the vertex buffer and are appended to the index buffer of the mesh.
+            for (GeometrySurface& surface : newMesh->surfaces)
+            {
+                surface.lods = GenerateLods(positions, indices, surface.startIndex, surface.indexCount);
+            }
+
+            // Compact positions are relative to the bounds of their surface, which works because surfaces never share vertices.
+            if (renderer->compactVertices)
+            {
+                compactVertices.resize(vertices.size());
+                for (size_t i = 0; i < newMesh->surfaces.size(); i++)
+                {
+                    const size_t begin = surfaceVertexBegins[i];
+                    const size_t end   = i + 1 < surfaceVertexBegins.size() ? surfaceVertexBegins[i + 1] : vertices.size();
+
+                    const tcb::span<const Vertex> surfaceVertices = tcb::span<const Vertex>(vertices).subspan(begin, end - begin);
+                    CompressVertices(surfaceVertices, newMesh->surfaces[i].bounds, compactVertices.data() + begin);
+                }
+                newMesh->buffers = renderer->UploadMesh(indices, compactVertices);
+            }
+            else
+            {
+                newMesh->buffers = renderer->UploadMesh(indices, vertices);
+            }
         }
 
         for (fastgltf::Node& node : gltfAsset.nodes)
@@ -424,12 +512,14 @@ namespace lumina
             }
 
             nodes.push_back(newNode);
-            file.nodes[node.name.c_str()];
+            file.nodes[node.name.c_str()] = newNode;
 
             std::visit(
                 fastgltf::visitor {
                     [&](const fastgltf::Node::TransformMatrix& matrix) {
-                        memcpy(&newNode->localTransform, matrix.data(), sizeof(matrix));
+                        glm::mat4 localMatrix;
+                        memcpy(&localMatrix, matrix.data(), sizeof(matrix));
+                        newNode->localTransform = AffineTransform::FromMatrix(localMatrix);
                     },
                     [&](const fastgltf::TRS& transform) {
                         float3 translation(transform.translation[0], transform.translation[1], transform.translation[2]);
@@ -440,7 +530,7 @@ namespace lumina
                         glm::mat4 rotationMatrix  = glm::toMat4(rotation);
                         glm::mat4 scaleMatrix     = glm::scale(glm::mat4(1.0f), scale);
 
-                        newNode->localTransform = transformMatrix * rotationMatrix * scaleMatrix;
+                        newNode->localTransform = AffineTransform::FromMatrix(transformMatrix * rotationMatrix * scaleMatrix);
                     }},
                 node.transform);
         }
@@ -461,9 +551,12 @@ namespace lumina
             if (node->parent.lock() == nullptr)
             {
                 file.topNodes.push_back(node);
-                node->RefreshTransforms(glm::mat4 {1.0f});
             }
         }
+
+        file.BuildTransformHierarchy();
+        file.UpdateTransforms(AffineTransform::Identity());
+
         return scene;
     }
 
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include "transform_hierarchy.hpp"
 #include "vk_descriptors.hpp"
 #include "vk_types.hpp"
 
@@ -21,6 +22,9 @@ namespace lumina
         uint32_t indexCount;
         Bounds bounds;
         std::shared_ptr<GLTFMaterial> material;
+
+        // Simplified versions of the surface stored behind the original indices, the first level is the original range.
+        std::vector<MeshLod> lods;
     };
 
     struct MeshAsset
@@ -28,6 +32,7 @@ namespace lumina
         std::string name;
         std::vector<GeometrySurface> surfaces;
         GPUMeshBuffers buffers;
+        std::shared_ptr<OccluderGeometry> occluder;
     };
 
     struct LoadedGLTF : public IRenderable
@@ -41,16 +46,23 @@ namespace lumina
         std::vector<std::shared_ptr<Node>> topNodes;
         std::vector<VkSampler> samplers;
 
-        DescriptorAllocatorGrowable descriptorPool;
-        AllocatedBuffer materialDataBuffer;
+        TransformHierarchy transforms;
+        std::vector<Node*> transformNodes;
+
         VulkanRenderer* creator;
+        DrawContext* drawContext {nullptr};
 
         ~LoadedGLTF()
         {
             ClearAll();
         }
 
-        void Draw(const glm::mat4& topMatrix, DrawContext& context) override;
+        void Register(DrawContext& context) override;
+        void Unregister(DrawContext& context) override;
+
+        void BuildTransformHierarchy();
+        void SetLocalTransform(Node& node, const AffineTransform& localTransform);
+        void UpdateTransforms(const AffineTransform& topMatrix);
 
     private:
         void ClearAll();
@@ -65,7 +65,7 @@ namespace lumina
 
         colorBlending.logicOpEnable   = VK_FALSE;
         colorBlending.logicOp         = VK_LOGIC_OP_COPY;
-        colorBlending.attachmentCount = 1;
+        colorBlending.attachmentCount = renderingCreateInfo.colorAttachmentCount;
         colorBlending.pAttachments    = &colorBlendAttachment;
 
         VkPipelineVertexInputStateCreateInfo vertexInputInfo {};
@@ -115,6 +115,13 @@ namespace lumina
         shaderStages.push_back(vkinit::PipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
     }
 
+    void PipelineBuilder::SetVertexShader(VkShaderModule vertexShader)
+    {
+        shaderStages.clear();
+
+        shaderStages.push_back(vkinit::PipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, vertexShader));
+    }
+
     void PipelineBuilder::SetInputTopology(VkPrimitiveTopology topology)
     {
         inputAssemblyState.topology               = topology;
@@ -180,6 +187,12 @@ namespace lumina
         renderingCreateInfo.pColorAttachmentFormats = &colorAttachmentFormat;
     }
 
+    void PipelineBuilder::DisableColorAttachment()
+    {
+        renderingCreateInfo.colorAttachmentCount    = 0;
+        renderingCreateInfo.pColorAttachmentFormats = nullptr;
+    }
+
     void PipelineBuilder::SetDepthFormat(VkFormat format)
     {
         renderingCreateInfo.depthAttachmentFormat = format;
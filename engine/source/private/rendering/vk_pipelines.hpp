@@ -32,6 +32,8 @@ namespace lumina
 
         VkPipeline BuildPipeline(VkDevice device) const;
         void SetShaders(VkShaderModule vertexShader, VkShaderModule fragmentShader);
+        // Depth only passes can leave out the fragment stage entirely.
+        void SetVertexShader(VkShaderModule vertexShader);
         void SetInputTopology(VkPrimitiveTopology topology);
         void SetPolygonMode(VkPolygonMode mode);
         void SetCullMode(VkCullModeFlags mode, VkFrontFace frontFace);
@@ -40,6 +42,7 @@ namespace lumina
         void EnableBlendingAdditive();
         void EnableBlendingAlphaBlend();
         void SetColorAttachmentFormat(VkFormat format);
+        void DisableColorAttachment();
         void SetDepthFormat(VkFormat format);
         void DisableDepthTest();
         void EnableDepthTest(bool depthWriteEnable, VkCompareOp compareOp);
@@ -4,9 +4,12 @@
 #include "../rendering/vk_images.hpp"
 #include "../rendering/vk_initializers.hpp"
 #include "../rendering/vk_types.hpp"
+#include "core/radix_sort.hpp"
+#include "culling.hpp"
 #include "imgui/include/imgui.h"
 #include "imgui/include/imgui_impl_sdl2.h"
 #include "imgui/include/imgui_impl_vulkan.h"
+#include "mesh_lod.hpp"
 
 #include <SDL/SDL.h>
 #include <SDL/SDL_vulkan.h>
@@ -15,8 +18,11 @@
 #include "imgui_internal.h"
 #include "vk_pipelines.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <glm/ext/matrix_transform.hpp>
+#include <numeric>
 #include <vma/vk_mem_alloc.h>
 
 #ifdef _DEBUG
@@ -27,43 +33,19 @@ constexpr bool USE_VALIDATION_LAYERS = false;
 
 namespace lumina
 {
-    bool IsVisible(const RenderObject& object, const glm::mat4& viewProjection)
+    // Moves the results that chunks wrote at their own begin offset next to each other, keeping them in chunk order.
+    void CompactChunks(std::vector<uint32_t>& values, const std::vector<uint32_t>& chunkBegins, const std::vector<uint32_t>& chunkCounts)
     {
-        std::array<glm::vec3, 8> corners {
-            glm::vec3 {1, 1, 1},
-            glm::vec3 {1, 1, -1},
-            glm::vec3 {1, -1, 1},
-            glm::vec3 {1, -1, -1},
-            glm::vec3 {-1, 1, 1},
-            glm::vec3 {-1, 1, -1},
-            glm::vec3 {-1, -1, 1},
-            glm::vec3 {-1, -1, -1},
-        };
-
-        glm::mat4 matrix = viewProjection * object.transform;
-
-        auto min = float3 {1.5f, 1.5f, 1.5f};
-        auto max = float3 {-1.5f, -1.5f, -1.5f};
-
-        for (int c = 0; c < 8; c++)
-        {
-            float4 v = matrix * float4(object.bounds.origin + (corners[c] * object.bounds.extents), 1.0f);
-
-            v.x = v.x / v.w;
-            v.y = v.y / v.w;
-            v.z = v.z / v.w;
-
-            min = glm::min(float3 {v.x, v.y, v.z}, min);
-            max = glm::max(float3 {v.x, v.y, v.z}, max);
-        }
-        if (min.z > 1.0f || max.z < 0.0f || min.x > 1.0f || max.x < -1.0f || min.y > 1.0f || max.y < -1.0f)
-        {
-            return false;
-        }
-        else
+        uint32_t count = 0;
+        for (size_t chunk = 0; chunk < chunkCounts.size(); chunk++)
         {
-            return true;
+            if (chunkBegins[chunk] != count)
+            {
+                std::copy_n(values.begin() + chunkBegins[chunk], chunkCounts[chunk], values.begin() + count);
+            }
+            count += chunkCounts[chunk];
         }
+        values.resize(count);
     }
 
     VulkanRenderer::VulkanRenderer()
@@ -149,10 +131,53 @@ namespace lumina
         VkPhysicalDeviceVulkan12Features features12 {};
         features12.bufferDeviceAddress = true;
         features12.descriptorIndexing  = true;
+        features12.timelineSemaphore   = true;
+
+        // Bindless materials index one large, partially bound texture array that is written while in use. There is no per-material
+        // descriptor set fallback, devices without these features are not selected.
+        features12.runtimeDescriptorArray                       = true;
+        features12.descriptorBindingPartiallyBound              = true;
+        features12.descriptorBindingSampledImageUpdateAfterBind = true;
+        features12.shaderSampledImageArrayNonUniformIndexing    = true;
+
+        const auto selectPhysicalDevice = [&](const VkPhysicalDeviceFeatures& requiredFeatures) {
+            vkb::PhysicalDeviceSelector selector {vkbInstance};
+            return selector.set_minimum_version(1, 3)
+                .set_required_features(requiredFeatures)
+                .set_required_features_13(features13)
+                .set_required_features_12(features12)
+                .set_surface(surface)
+                .select()
+                .value();
+        };
+
+        vkb::PhysicalDevice physicalDevice = selectPhysicalDevice(VkPhysicalDeviceFeatures {});
+
+        // GPU driven culling is optional. It draws with indirect counts and passes the object index of every indirect draw as its
+        // first instance, so those features are only required when the selected device has them.
+        VkPhysicalDeviceVulkan12Features supportedFeatures12 {};
+        supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 supportedFeatures {};
+        supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext = &supportedFeatures12;
+        vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device, &supportedFeatures);
+
+        gpuCullingSupported = supportedFeatures12.drawIndirectCount && supportedFeatures.features.drawIndirectFirstInstance;
+        if (gpuCullingSupported)
+        {
+            features12.drawIndirectCount = true;
+
+            VkPhysicalDeviceFeatures features {};
+            features.drawIndirectFirstInstance = true;
+            physicalDevice                     = selectPhysicalDevice(features);
+        }
+        else
+        {
+            Log::Warn("Device lacks drawIndirectCount or drawIndirectFirstInstance, GPU driven culling is unavailable");
+        }
 
-        vkb::PhysicalDeviceSelector selector {vkbInstance};
-        vkb::PhysicalDevice physicalDevice =
-            selector.set_minimum_version(1, 3).set_required_features_13(features13).set_required_features_12(features12).set_surface(surface).select().value();
+        // Lets VMA report real heap budgets instead of estimating them from its own allocations.
+        const bool memoryBudget = physicalDevice.enable_extension_if_present(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
         vkb::DeviceBuilder deviceBuilder {physicalDevice};
         vkb::Device vkbDevice = deviceBuilder.build().value();
@@ -164,15 +189,54 @@ namespace lumina
         graphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
 
         VmaAllocatorCreateInfo allocatorInfo {};
-        allocatorInfo.physicalDevice = chosenGPU;
-        allocatorInfo.device         = device;
-        allocatorInfo.instance       = instance;
-        allocatorInfo.flags          = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+        allocatorInfo.physicalDevice   = chosenGPU;
+        allocatorInfo.device           = device;
+        allocatorInfo.instance         = instance;
+        allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_3;
+        allocatorInfo.flags            = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+        if (memoryBudget)
+        {
+            allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+        }
         vmaCreateAllocator(&allocatorInfo, &allocator);
 
         mainDeletionQueue.PushFunction([&]() {
             vmaDestroyAllocator(allocator);
         });
+        mainDeletionQueue.PushFunction([&]() {
+            retirementQueue.Flush(device, allocator);
+        });
+
+        // Uploads use a transfer only queue family when there is one, so their copies can overlap with rendering.
+        const auto dedicatedTransferQueue = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+        if (dedicatedTransferQueue.has_value())
+        {
+            const uint32_t transferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+            uploadQueue.Init(device, allocator, dedicatedTransferQueue.value(), transferQueueFamily, graphicsQueue, graphicsQueueFamily);
+        }
+        else
+        {
+            uploadQueue.Init(device, allocator, graphicsQueue, graphicsQueueFamily, graphicsQueue, graphicsQueueFamily);
+        }
+        mainDeletionQueue.PushFunction([&]() {
+            uploadQueue.Cleanup();
+        });
+
+        geometryPool.Init(compactVertices ? sizeof(CompactVertex) : sizeof(Vertex));
+        mainDeletionQueue.PushFunction([&]() {
+            geometryPool.Cleanup(allocator);
+        });
+
+        // Transient allocations are bound as uniform and storage buffers at arbitrary offsets.
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(chosenGPU, &properties);
+        const VkDeviceSize transientAlignment = std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment);
+        timestampPeriod                       = properties.limits.timestampPeriod;
+
+        for (auto& frame : frames)
+        {
+            frame.transientAllocator.Init(device, allocator, TransientAllocator::DEFAULT_CAPACITY, transientAlignment);
+        }
     }
 
     void VulkanRenderer::Draw()
@@ -200,13 +264,65 @@ namespace lumina
         ImGui::Text("Frame Time : %f ms", stats.frameTime);
         ImGui::Text("Draw Time:  %f ms", stats.drawTime);
         ImGui::Text("Scene Update Time: %f ms", stats.sceneUpdateTime);
+        ImGui::Text("Cull Time: %f ms", stats.cullTime);
+        ImGui::Text("Sort Time: %f ms", stats.sortTime);
+        ImGui::Text("Depth Prepass GPU Time: %f ms", stats.prepassGPUTime);
+        ImGui::Text("Main Pass GPU Time: %f ms", stats.mainPassGPUTime);
         ImGui::Text("Triangles: %i", stats.triangleCount);
         ImGui::Text("Draw Calls: %i", stats.drawCallCount);
+        if (ImGui::CollapsingHeader("GPU Memory"))
+        {
+            constexpr float bytesToMegabytes         = 1.0f / (1024.0f * 1024.0f);
+            const tcb::span<const VmaBudget> budgets = HeapBudgets();
+            for (uint32_t heap = 0; heap < budgets.size(); heap++)
+            {
+                ImGui::Text(
+                    "Heap %u%s: %.1f / %.1f MB",
+                    heap,
+                    IsDeviceLocalHeap(heap) ? " (device local)" : "",
+                    static_cast<float>(budgets[heap].usage) * bytesToMegabytes,
+                    static_cast<float>(budgets[heap].budget) * bytesToMegabytes);
+            }
+            for (uint8_t category = 0; category < static_cast<uint8_t>(MemoryCategory::Count); category++)
+            {
+                const MemoryCategoryUsage usage = GPUMemory::Usage(static_cast<MemoryCategory>(category));
+                ImGui::Text(
+                    "%s: %.1f MB in %u allocations",
+                    ToString(static_cast<MemoryCategory>(category)),
+                    static_cast<float>(usage.bytes) * bytesToMegabytes,
+                    usage.allocationCount);
+            }
+        }
         ImGui::Checkbox("Opaque Sorting", &enableOpaqueSorting);
         if (ImGui::Checkbox("CPU Frustum Culling", &enableCPUFrustumCulling))
         {
             enableOpaqueSorting = true;
         }
+        ImGui::Checkbox("Parallel Culling", &enableParallelCulling);
+        ImGui::Checkbox("Hierarchical Culling", &enableHierarchicalCulling);
+        ImGui::Checkbox("Occlusion Culling", &enableOcclusionCulling);
+        ImGui::SliderInt("Occluders", &maxOccluders, 1, 128);
+        ImGui::Text("Occluded: %i", stats.occludedCount);
+        if (ImGui::Checkbox("Contribution Culling", &enableContributionCulling))
+        {
+            enableOpaqueSorting = true;
+        }
+        ImGui::SliderFloat("Min Pixel Coverage", &minPixelCoverage, 0.0f, 64.0f);
+        ImGui::Text("Contribution Culled: %i", stats.contributionCulledCount);
+        ImGui::Checkbox("LOD Selection", &enableLodSelection);
+        ImGui::SliderFloat("LOD Pixel Error", &lodPixelError, 0.25f, 16.0f);
+        ImGui::Checkbox("Instancing", &enableInstancing);
+        ImGui::Checkbox("Parallel Recording", &enableParallelRecording);
+        ImGui::BeginDisabled(metallicRoughnessMaterial.opaquePipeline.depthPrepassPipeline == VK_NULL_HANDLE);
+        ImGui::Checkbox("Depth Prepass", &enableDepthPrepass);
+        ImGui::EndDisabled();
+        ImGui::BeginDisabled(!gpuCulling.IsAvailable());
+        ImGui::Checkbox("GPU Driven Culling", &enableGPUDrivenCulling);
+        ImGui::EndDisabled();
+        if (ImGui::Button("Run Culling Benchmark"))
+        {
+            RunCullingBenchmark();
+        }
         ImGui::End();
 
         ImGui::Begin("Vulkan Renderer");
@@ -237,8 +353,14 @@ namespace lumina
 
         VK_CHECK(vkWaitForFences(device, 1, &GetCurrentFrame().renderFence, true, singleSecond));
 
-        GetCurrentFrame().deletionQueue.Flush();
+        if (frameNumber >= FRAME_OVERLAP)
+        {
+            retirementQueue.Collect(device, allocator, frameNumber - FRAME_OVERLAP);
+        }
         GetCurrentFrame().frameDescriptors->ClearPools(device);
+        GetCurrentFrame().transientAllocator.Reset(allocator);
+        ReadPassTimings(GetCurrentFrame());
+        UpdateMemoryBudgets();
 
         uint32_t swapchainImageIndex {};
         VkResult result = vkAcquireNextImageKHR(device, swapchain, singleSecond, GetCurrentFrame().swapchainSemaphore, nullptr, &swapchainImageIndex);
@@ -289,11 +411,17 @@ namespace lumina
 
         const VkCommandBufferSubmitInfo commandInfo = vkinit::CommandBufferSubmitInfo(command);
 
-        const VkSemaphoreSubmitInfo waitInfo =
-            vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, GetCurrentFrame().swapchainSemaphore);
+        // The frame may use anything uploaded so far, waiting on the upload timeline costs nothing once those batches are done.
+        VkSemaphoreSubmitInfo uploadWaitInfo = vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, uploadQueue.Semaphore());
+        uploadWaitInfo.value                 = uploadQueue.Flush();
+
+        const VkSemaphoreSubmitInfo waitInfos[] = {
+            vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR, GetCurrentFrame().swapchainSemaphore),
+            uploadWaitInfo};
         const VkSemaphoreSubmitInfo signalInfo = vkinit::SemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, GetCurrentFrame().renderSemaphore);
 
-        const VkSubmitInfo2 submit = vkinit::SubmitInfo(&commandInfo, &signalInfo, &waitInfo);
+        VkSubmitInfo2 submit          = vkinit::SubmitInfo(&commandInfo, &signalInfo, waitInfos);
+        submit.waitSemaphoreInfoCount = 2;
 
         VK_CHECK(vkQueueSubmit2(graphicsQueue, 1, &submit, GetCurrentFrame().renderFence));
 
@@ -333,154 +461,484 @@ namespace lumina
             1);
     }
 
+    void VulkanRenderer::CullOccluded(std::vector<uint32_t>& draws, uint32_t chunkSize)
+    {
+        const std::vector<RenderObject>& surfaces = mainDrawContext.OpaqueSurfaces();
+        const CullingBounds& bounds               = mainDrawContext.OpaqueBounds();
+
+        // The surfaces that cover the largest part of the screen make the best occluders.
+        occluderCandidates.clear();
+        for (const uint32_t index : draws)
+        {
+            if (surfaces[index].occluder != nullptr)
+            {
+                const float3 toCamera       = float3 {bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]} - mainCamera.position;
+                const float distanceSquared = std::max(glm::dot(toCamera, toCamera), 0.01f);
+                occluderCandidates.emplace_back(bounds.radius[index] * bounds.radius[index] / distanceSquared, index);
+            }
+        }
+
+        const size_t occluderCount = std::min(occluderCandidates.size(), static_cast<size_t>(std::max(maxOccluders, 0)));
+        std::partial_sort(occluderCandidates.begin(), occluderCandidates.begin() + occluderCount, occluderCandidates.end(), std::greater<>());
+
+        occlusionBuffer.Clear(sceneData.viewProj);
+        for (size_t i = 0; i < occluderCount; i++)
+        {
+            const RenderObject& occluder = surfaces[occluderCandidates[i].second];
+            occlusionBuffer.RasterizeOccluder(*occluder.occluder, occluder.firstIndex, occluder.indexCount, occluder.transform);
+        }
+
+        // Same chunked compaction as the frustum test, a chunk never writes past the entry it is reading.
+        const auto drawCount = static_cast<uint32_t>(draws.size());
+        cullChunkBegins.resize(ThreadPool::ChunkCount(drawCount, chunkSize));
+        cullChunkCounts.assign(cullChunkBegins.size(), 0);
+
+        workerPool.ParallelFor(drawCount, chunkSize, [&](uint32_t begin, uint32_t end, uint32_t chunk) {
+            uint32_t count = 0;
+            for (uint32_t i = begin; i < end; i++)
+            {
+                const uint32_t index = draws[i];
+                const float3 center {bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]};
+                const float3 extent {bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index]};
+
+                draws[begin + count] = index;
+                count += occlusionBuffer.IsVisible(center, extent) ? 1 : 0;
+            }
+            cullChunkBegins[chunk] = begin;
+            cullChunkCounts[chunk] = count;
+        });
+
+        CompactChunks(draws, cullChunkBegins, cullChunkCounts);
+        stats.occludedCount = static_cast<int>(drawCount - draws.size());
+    }
+
     void VulkanRenderer::DrawGeometry(VkCommandBuffer command)
     {
         stats.drawCallCount = 0;
         stats.triangleCount = 0;
 
         auto start = std::chrono::system_clock::now();
+
+        const std::vector<RenderObject>& opaqueSurfaces      = mainDrawContext.OpaqueSurfaces();
+        const std::vector<RenderObject>& transparentSurfaces = mainDrawContext.TransparentSurfaces();
+
+        // Size in pixels of one world unit at a distance of one, used for everything measured in screen space.
+        const float pixelScale = static_cast<float>(drawExtent.height) * 0.5f * std::abs(sceneData.proj[1][1]);
+
+        // The GPU path culls and batches the opaque surfaces itself, it only needs its data to be up to date before rendering starts.
+        const bool gpuDriven    = enableGPUDrivenCulling && gpuCulling.IsAvailable();
+        const uint32_t gpuFrame = frameNumber % FRAME_OVERLAP;
+
+        // Timed the same way on every path, including the one that culls nothing.
+        const auto cullStart        = std::chrono::system_clock::now();
+        const auto surfaceCount     = static_cast<uint32_t>(opaqueSurfaces.size());
+        const uint32_t chunkSize    = enableParallelCulling ? CULLING_CHUNK_SIZE : std::max(surfaceCount, 1u);
+        const Frustum frustum       = Frustum::FromMatrix(sceneData.viewProj);
+        const CullingBounds& bounds = mainDrawContext.OpaqueBounds();
+
+        stats.occludedCount           = 0;
+        stats.contributionCulledCount = 0;
+
         std::vector<uint32_t> opaqueDraws;
-        if (enableOpaqueSorting)
+        if (gpuDriven)
         {
-            opaqueDraws.reserve(mainDrawContext.opaqueSurfaces.size());
+            gpuCulling.Prepare(gpuFrame, mainDrawContext, device, allocator);
+            gpuCulling.RecordCulling(command, gpuFrame, frustum);
+        }
+        else if (enableOpaqueSorting)
+        {
+            // Every chunk writes its visible surfaces into its own range of opaqueDraws, which are compacted afterwards.
+            opaqueDraws.resize(surfaceCount);
 
-            for (uint32_t i = 0; i < mainDrawContext.opaqueSurfaces.size(); i++)
-            {
-                if (enableCPUFrustumCulling)
+            std::atomic<int> contributionCulled {0};
+            auto cullContribution = [&](uint32_t* indices, uint32_t count) {
+                if (!enableContributionCulling)
                 {
-                    if (IsVisible(mainDrawContext.opaqueSurfaces[i], sceneData.viewProj))
+                    return count;
+                }
+
+                const uint32_t kept = CullByContribution(bounds, mainCamera.position, pixelScale, minPixelCoverage, indices, count);
+                contributionCulled.fetch_add(static_cast<int>(count - kept), std::memory_order_relaxed);
+                return kept;
+            };
+
+            if (enableCPUFrustumCulling && enableHierarchicalCulling)
+            {
+                // Subtrees of the hierarchy cover contiguous item ranges, so they take the place of the flat chunks.
+                const BoundingVolumeHierarchy& hierarchy = mainDrawContext.UpdateOpaqueHierarchy();
+                hierarchy.CollectSubtrees(chunkSize, cullSubtrees);
+
+                cullChunkBegins.resize(cullSubtrees.size());
+                cullChunkCounts.assign(cullSubtrees.size(), 0);
+
+                workerPool.ParallelFor(static_cast<uint32_t>(cullSubtrees.size()), 1, [&](uint32_t, uint32_t, uint32_t chunk) {
+                    const uint32_t node    = cullSubtrees[chunk];
+                    cullChunkBegins[chunk] = hierarchy.ItemBegin(node);
+                    cullChunkCounts[chunk] = cullContribution(
+                        opaqueDraws.data() + cullChunkBegins[chunk],
+                        hierarchy.Cull(frustum, node, opaqueDraws.data() + cullChunkBegins[chunk]));
+                });
+            }
+            else
+            {
+                cullChunkBegins.resize(ThreadPool::ChunkCount(surfaceCount, chunkSize));
+                cullChunkCounts.assign(cullChunkBegins.size(), 0);
+
+                workerPool.ParallelFor(surfaceCount, chunkSize, [&](uint32_t begin, uint32_t end, uint32_t chunk) {
+                    cullChunkBegins[chunk] = begin;
+                    if (enableCPUFrustumCulling)
                     {
-                        opaqueDraws.push_back(i);
+                        const uint32_t visible = CullAABBs(frustum, bounds, begin, end, opaqueDraws.data() + begin);
+                        cullChunkCounts[chunk] = cullContribution(opaqueDraws.data() + begin, visible);
                     }
-                }
-                else
-                {
-                    opaqueDraws.push_back(i);
-                }
+                    else
+                    {
+                        std::iota(opaqueDraws.begin() + begin, opaqueDraws.begin() + end, begin);
+                        cullChunkCounts[chunk] = cullContribution(opaqueDraws.data() + begin, end - begin);
+                    }
+                });
             }
 
-            std::sort(opaqueDraws.begin(), opaqueDraws.end(), [&](const auto& iA, const auto& iB) {
-                const RenderObject& a = mainDrawContext.opaqueSurfaces[iA];
-                const RenderObject& b = mainDrawContext.opaqueSurfaces[iB];
-                if (a.material == b.material)
-                {
-                    return a.indexBuffer < b.indexBuffer;
-                }
-                else
+            CompactChunks(opaqueDraws, cullChunkBegins, cullChunkCounts);
+            stats.contributionCulledCount = contributionCulled.load();
+
+            if (enableCPUFrustumCulling && enableOcclusionCulling)
+            {
+                CullOccluded(opaqueDraws, chunkSize);
+            }
+        }
+
+        const auto cullEnd = std::chrono::system_clock::now();
+        stats.cullTime     = std::chrono::duration_cast<std::chrono::microseconds>(cullEnd - cullStart).count() / 1000.0f;
+
+        if (!gpuDriven && enableOpaqueSorting)
+        {
+            // Keys group the draws by pipeline, material and index buffer, and go front to back within each group.
+            const auto sortStart                  = std::chrono::system_clock::now();
+            const std::vector<uint64_t>& sortKeys = mainDrawContext.OpaqueSortKeys();
+            const auto drawCount                  = static_cast<uint32_t>(opaqueDraws.size());
+
+            drawSortKeys.resize(drawCount);
+            workerPool.ParallelFor(drawCount, chunkSize, [&](uint32_t begin, uint32_t end, uint32_t) {
+                for (uint32_t i = begin; i < end; i++)
                 {
-                    return a.material < b.material;
+                    const uint32_t index = opaqueDraws[i];
+                    const float3 offset  = float3 {bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]} - mainCamera.position;
+                    drawSortKeys[i]      = sortKeys[index] | DrawContext::DepthSortKey(glm::dot(offset, offset));
                 }
             });
-        }
-        VkRenderingAttachmentInfo colorAttachment = vkinit::AttachmentInfo(drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_GENERAL);
-        VkRenderingAttachmentInfo depthAttachment = vkinit::DepthAttachmentInfo(depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
-        VkRenderingInfo renderInfo                = vkinit::RenderingInfo(drawExtent, &colorAttachment, &depthAttachment);
 
-        vkCmdBeginRendering(command, &renderInfo);
-
-        AllocatedBuffer gpuSceneDataBuffer = CreateBuffer(allocator, sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+            RadixSort(drawSortKeys, opaqueDraws, drawSortScratchKeys, drawSortScratchIndices);
 
-        GetCurrentFrame().deletionQueue.PushFunction([gpuSceneDataBuffer, this]() {
-            DestroyBuffer(allocator, gpuSceneDataBuffer);
-        });
+            const auto sortEnd = std::chrono::system_clock::now();
+            stats.sortTime     = std::chrono::duration_cast<std::chrono::microseconds>(sortEnd - sortStart).count() / 1000.0f;
+        }
+        FrameData& frame = GetCurrentFrame();
 
-        auto* sceneDataUniform = static_cast<GPUSceneData*>(gpuSceneDataBuffer.allocation->GetMappedData());
-        *sceneDataUniform      = sceneData;
+        const TransientAllocation sceneDataAllocation = frame.transientAllocator.Allocate(allocator, sizeof(GPUSceneData));
+        *static_cast<GPUSceneData*>(sceneDataAllocation.data) = sceneData;
 
-        VkDescriptorSet globalDescriptor = GetCurrentFrame().frameDescriptors->Allocate(device, gpuSceneDataDescriptorLayout);
+        VkDescriptorSet globalDescriptor = frame.frameDescriptors->Allocate(device, gpuSceneDataDescriptorLayout);
 
         DescriptorWriter writer {};
-        writer.WriteBuffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        writer.WriteBuffer(0, sceneDataAllocation.buffer, sizeof(GPUSceneData), sceneDataAllocation.offset, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
         writer.UpdateSet(device, globalDescriptor);
 
-        MaterialInstance* lastMaterial = nullptr;
-        MaterialPipeline* lastPipeline = nullptr;
-        VkBuffer lastIndexBuffer       = VK_NULL_HANDLE;
+        // Surfaces are gathered in draw order first, so runs of the same mesh and material can be drawn as instances.
+        orderedDraws.clear();
+        if (gpuDriven)
+        {
+            stats.drawCallCount += static_cast<int>(gpuCulling.BatchCount(gpuFrame));
+
+            for (uint32_t r : gpuCulling.FallbackSurfaces(gpuFrame))
+            {
+                orderedDraws.push_back(&opaqueSurfaces[r]);
+            }
+        }
+        else if (enableOpaqueSorting)
+        {
+            for (auto& r : opaqueDraws)
+            {
+                orderedDraws.push_back(&opaqueSurfaces[r]);
+            }
+        }
+        else
+        {
+            for (auto& r : opaqueSurfaces)
+            {
+                orderedDraws.push_back(&r);
+            }
+        }
+
+        // Only opaque surfaces take part in the depth prepass, transparent ones are tested against it without writing depth.
+        const bool depthPrepass      = enableDepthPrepass && metallicRoughnessMaterial.opaquePipeline.depthPrepassPipeline != VK_NULL_HANDLE;
+        const size_t opaqueDrawCount = orderedDraws.size();
 
-        auto draw = [&](const RenderObject& draw) {
-            if (draw.material != lastMaterial)
+        for (auto& r : transparentSurfaces)
+        {
+            orderedDraws.push_back(&r);
+        }
+
+        const TransientAllocation instanceAllocation = frame.transientAllocator.Allocate(allocator, orderedDraws.size() * sizeof(AffineTransform));
+
+        auto* instanceTransforms = static_cast<AffineTransform*>(instanceAllocation.data);
+        for (size_t i = 0; i < orderedDraws.size(); i++)
+        {
+            instanceTransforms[i] = orderedDraws[i]->transform;
+        }
+
+        auto indexRange = [&](const RenderObject& draw) {
+            if (enableLodSelection && !draw.lods.empty())
+            {
+                return draw.lods[SelectLod(draw.lods, draw.bounds, draw.transform, mainCamera.position, pixelScale, lodPixelError)];
+            }
+            return MeshLod {draw.firstIndex, draw.indexCount, 0.0f};
+        };
+
+        std::atomic<int> drawCallCount {0};
+        std::atomic<int> triangleCount {0};
+
+        // Depth only draws use the prepass pipeline, shading after a prepass tests for equal depth.
+        auto passPipeline = [&](const MaterialPipeline& pipeline, bool depthOnly) {
+            if (depthOnly)
             {
-                lastMaterial = draw.material;
+                return pipeline.depthPrepassPipeline;
+            }
+            return depthPrepass && pipeline.depthEqualPipeline != VK_NULL_HANDLE ? pipeline.depthEqualPipeline : pipeline.pipeline;
+        };
+
+        // Records the ordered draws in [begin, end) with no state assumed, which makes it safe to run for several ranges at once.
+        auto recordDraws = [&](VkCommandBuffer cmd, size_t begin, size_t end, bool depthOnly, bool recordIndirect) {
+            // Every pipeline uses dynamic viewport and scissor, which stay set across pipeline binds but are not inherited.
+            VkViewport viewport {};
+            viewport.x        = 0;
+            viewport.y        = 0;
+            viewport.width    = static_cast<float>(drawExtent.width);
+            viewport.height   = static_cast<float>(drawExtent.height);
+            viewport.minDepth = 0.0f;
+            viewport.maxDepth = 1.0f;
+
+            vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+            VkRect2D scissor {};
+            scissor.offset = {0, 0};
+            scissor.extent = drawExtent;
+
+            vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+            if (recordIndirect)
+            {
+                gpuCulling.RecordDraws(cmd, gpuFrame, globalDescriptor, bindlessMaterials.Set());
+            }
+
+            MaterialInstance* lastMaterial   = nullptr;
+            MaterialPipeline* lastPipeline   = nullptr;
+            VkBuffer lastIndexBuffer         = VK_NULL_HANDLE;
+            VkIndexType lastIndexType        = VK_INDEX_TYPE_UINT32;
+            VkDeviceAddress lastVertexBuffer = 0;
+            Bounds lastBounds                = {};
+            int drawCalls                    = 0;
+            int triangles                    = 0;
+
+            for (size_t first = begin; first < end;)
+            {
+                const RenderObject& draw = *orderedDraws[first];
+                const MeshLod range      = indexRange(draw);
+
+                size_t last = first + 1;
+                if (enableInstancing)
+                {
+                    while (last < end)
+                    {
+                        const RenderObject& next = *orderedDraws[last];
+                        if (next.material != draw.material || next.indexBuffer != draw.indexBuffer || next.indexType != draw.indexType
+                            || next.indexOffset != draw.indexOffset || next.vertexOffset != draw.vertexOffset
+                            || next.vertexBufferDeviceAddress != draw.vertexBufferDeviceAddress)
+                        {
+                            break;
+                        }
+
+                        const MeshLod nextRange = indexRange(next);
+                        if (nextRange.startIndex != range.startIndex || nextRange.indexCount != range.indexCount)
+                        {
+                            break;
+                        }
+                        last++;
+                    }
+                }
+
+                // Both pipelines share their layout, so the sets only have to be bound again when that changes.
                 if (draw.material->pipeline != lastPipeline)
                 {
+                    if (lastPipeline == nullptr || draw.material->pipeline->pipelineLayout != lastPipeline->pipelineLayout)
+                    {
+                        const VkDescriptorSet sets[] = {globalDescriptor, bindlessMaterials.Set()};
+                        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.material->pipeline->pipelineLayout, 0, 2, sets, 0, nullptr);
+                        lastMaterial = nullptr;
+                    }
                     lastPipeline = draw.material->pipeline;
-                    vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.material->pipeline->pipeline);
-                    vkCmdBindDescriptorSets(
-                        command,
-                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, passPipeline(*draw.material->pipeline, depthOnly));
+                }
+                if (draw.indexBuffer != lastIndexBuffer || draw.indexType != lastIndexType)
+                {
+                    lastIndexBuffer = draw.indexBuffer;
+                    lastIndexType   = draw.indexType;
+                    vkCmdBindIndexBuffer(cmd, draw.indexBuffer, 0, draw.indexType);
+                }
+
+                // A material change is only a different index in the push constants, compact vertices also need the surface bounds.
+                const bool boundsChanged = compactVertices && (draw.bounds.origin != lastBounds.origin || draw.bounds.extents != lastBounds.extents);
+                if (draw.material != lastMaterial || draw.vertexBufferDeviceAddress != lastVertexBuffer || boundsChanged)
+                {
+                    lastMaterial     = draw.material;
+                    lastVertexBuffer = draw.vertexBufferDeviceAddress;
+                    lastBounds       = draw.bounds;
+
+                    GPUDrawPushConstants pushConstants {};
+                    pushConstants.instanceBufferDeviceAddress = instanceAllocation.address;
+                    pushConstants.vertexBufferDeviceAddress   = draw.vertexBufferDeviceAddress;
+                    pushConstants.materialIndex               = draw.material->materialIndex;
+                    pushConstants.positionOrigin              = float4 {draw.bounds.origin, 0.0f};
+                    pushConstants.positionExtents             = float4 {draw.bounds.extents, 0.0f};
+                    vkCmdPushConstants(
+                        cmd,
                         draw.material->pipeline->pipelineLayout,
+                        VK_SHADER_STAGE_VERTEX_BIT,
                         0,
-                        1,
-                        &globalDescriptor,
-                        0,
-                        nullptr);
-
-                    VkViewport viewport {};
-                    viewport.x        = 0;
-                    viewport.y        = 0;
-                    viewport.width    = static_cast<float>(drawExtent.width);
-                    viewport.height   = static_cast<float>(drawExtent.height);
-                    viewport.minDepth = 0.0f;
-                    viewport.maxDepth = 1.0f;
+                        sizeof(GPUDrawPushConstants),
+                        &pushConstants);
+                }
 
-                    vkCmdSetViewport(command, 0, 1, &viewport);
+                const auto instanceCount = static_cast<uint32_t>(last - first);
+                vkCmdDrawIndexed(cmd, range.indexCount, instanceCount, draw.indexOffset + range.startIndex, draw.vertexOffset, static_cast<uint32_t>(first));
 
-                    VkRect2D scissor {};
-                    scissor.offset = {0, 0};
-                    scissor.extent = drawExtent;
+                drawCalls++;
+                triangles += range.indexCount / 3 * instanceCount;
 
-                    vkCmdSetScissor(command, 0, 1, &scissor);
-                }
-                vkCmdBindDescriptorSets(
-                    command,
-                    VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    draw.material->pipeline->pipelineLayout,
-                    1,
-                    1,
-                    &draw.material->materialSet,
-                    0,
-                    nullptr);
+                first = last;
             }
-            if (draw.indexBuffer != lastIndexBuffer)
+
+            // The stats count what is shaded, prepass draws repeat the same geometry.
+            if (!depthOnly)
             {
-                lastIndexBuffer = draw.indexBuffer;
-                vkCmdBindIndexBuffer(command, draw.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+                drawCallCount += drawCalls;
+                triangleCount += triangles;
             }
+        };
 
-            GPUDrawPushConstants pushConstants;
-            pushConstants.vertexBufferDeviceAddress = draw.vertexBufferDeviceAddress;
-            pushConstants.worldMatrix               = draw.transform;
-            vkCmdPushConstants(command, draw.material->pipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pushConstants);
-            vkCmdDrawIndexed(command, draw.indexCount, 1, draw.firstIndex, 0, 0);
+        VkRenderingAttachmentInfo colorAttachment        = vkinit::AttachmentInfo(drawImage.imageView, nullptr, VK_IMAGE_LAYOUT_GENERAL);
+        VkRenderingAttachmentInfo depthAttachment        = vkinit::DepthAttachmentInfo(depthImage.imageView, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+        VkRenderingAttachmentInfo prepassDepthAttachment = depthAttachment;
+        VkRenderingInfo renderInfo                       = vkinit::RenderingInfo(drawExtent, &colorAttachment, &depthAttachment);
+        VkRenderingInfo prepassRenderInfo                = vkinit::RenderingInfo(drawExtent, nullptr, &prepassDepthAttachment);
+        prepassRenderInfo.colorAttachmentCount           = 0;
 
-            stats.drawCallCount++;
-            stats.triangleCount += draw.indexCount / 3;
-        };
+        // The prepass clears depth, so the main pass has to keep what it wrote.
+        if (depthPrepass)
+        {
+            depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        }
+
+        vkCmdResetQueryPool(command, frame.timestampQueryPool, 0, TIMESTAMP_COUNT);
+        vkCmdWriteTimestamp2(command, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.timestampQueryPool, TIMESTAMP_PREPASS_BEGIN);
 
-        if (enableOpaqueSorting)
+        const auto drawCount = static_cast<uint32_t>(orderedDraws.size());
+        if (enableParallelRecording)
         {
-            for (auto& r : opaqueDraws)
+            // Each chunk goes into its own secondary command buffer. A run that straddles two chunks becomes two instanced draws.
+            const auto maxChunks       = static_cast<uint32_t>(frame.recordCommandBuffers.size());
+            const uint32_t chunks      = std::clamp(ThreadPool::ChunkCount(drawCount, RECORD_CHUNK_SIZE), 1u, maxChunks);
+            const VkFormat colorFormat = drawImage.imageFormat;
+
+            VkCommandBufferInheritanceRenderingInfo inheritanceRendering {};
+            inheritanceRendering.sType                   = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+            inheritanceRendering.colorAttachmentCount    = 1;
+            inheritanceRendering.pColorAttachmentFormats = &colorFormat;
+            inheritanceRendering.depthAttachmentFormat   = depthImage.imageFormat;
+            inheritanceRendering.rasterizationSamples    = VK_SAMPLE_COUNT_1_BIT;
+
+            VkCommandBufferInheritanceRenderingInfo prepassInheritanceRendering = inheritanceRendering;
+            prepassInheritanceRendering.colorAttachmentCount                    = 0;
+            prepassInheritanceRendering.pColorAttachmentFormats                 = nullptr;
+
+            VkCommandBufferInheritanceInfo inheritance {};
+            inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance.pNext = &inheritanceRendering;
+
+            VkCommandBufferInheritanceInfo prepassInheritance = inheritance;
+            prepassInheritance.pNext                          = &prepassInheritanceRendering;
+
+            VkCommandBufferBeginInfo secondaryBeginInfo =
+                vkinit::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+            secondaryBeginInfo.pInheritanceInfo = &inheritance;
+
+            VkCommandBufferBeginInfo prepassBeginInfo = secondaryBeginInfo;
+            prepassBeginInfo.pInheritanceInfo         = &prepassInheritance;
+
+            workerPool.ParallelFor(chunks, 1, [&](uint32_t, uint32_t, uint32_t chunk) {
+                VK_CHECK(vkResetCommandPool(device, frame.recordCommandPools[chunk], 0));
+
+                const size_t begin = static_cast<size_t>(drawCount) * chunk / chunks;
+                const size_t end   = static_cast<size_t>(drawCount) * (chunk + 1) / chunks;
+
+                if (depthPrepass)
+                {
+                    const VkCommandBuffer prepass = frame.prepassCommandBuffers[chunk];
+                    VK_CHECK(vkBeginCommandBuffer(prepass, &prepassBeginInfo));
+                    recordDraws(prepass, std::min<size_t>(begin, opaqueDrawCount), std::min<size_t>(end, opaqueDrawCount), true, false);
+                    VK_CHECK(vkEndCommandBuffer(prepass));
+                }
+
+                const VkCommandBuffer secondary = frame.recordCommandBuffers[chunk];
+                VK_CHECK(vkBeginCommandBuffer(secondary, &secondaryBeginInfo));
+                recordDraws(secondary, begin, end, false, gpuDriven && chunk == 0);
+                VK_CHECK(vkEndCommandBuffer(secondary));
+            });
+
+            if (depthPrepass)
             {
-                draw(mainDrawContext.opaqueSurfaces[r]);
+                prepassRenderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+                vkCmdBeginRendering(command, &prepassRenderInfo);
+                vkCmdExecuteCommands(command, chunks, frame.prepassCommandBuffers.data());
+                vkCmdEndRendering(command);
             }
+            vkCmdWriteTimestamp2(command, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.timestampQueryPool, TIMESTAMP_PREPASS_END);
+
+            // Makes the prepass depth writes visible to the depth tests of the main pass.
+            if (depthPrepass)
+            {
+                vkutil::TransitionImage(command, depthImage.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+            }
+
+            renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+            vkCmdBeginRendering(command, &renderInfo);
+            vkCmdExecuteCommands(command, chunks, frame.recordCommandBuffers.data());
         }
         else
         {
-            for (auto& r : mainDrawContext.opaqueSurfaces)
+            if (depthPrepass)
             {
-                draw(r);
+                vkCmdBeginRendering(command, &prepassRenderInfo);
+                recordDraws(command, 0, opaqueDrawCount, true, false);
+                vkCmdEndRendering(command);
             }
-        }
+            vkCmdWriteTimestamp2(command, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.timestampQueryPool, TIMESTAMP_PREPASS_END);
 
-        for (auto& r : mainDrawContext.transparentSurfaces)
-        {
-            draw(r);
-        }
+            if (depthPrepass)
+            {
+                vkutil::TransitionImage(command, depthImage.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+            }
 
-        mainDrawContext.opaqueSurfaces.clear();
-        mainDrawContext.transparentSurfaces.clear();
+            vkCmdBeginRendering(command, &renderInfo);
+            recordDraws(command, 0, drawCount, false, gpuDriven);
+        }
 
         vkCmdEndRendering(command);
+        vkCmdWriteTimestamp2(command, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.timestampQueryPool, TIMESTAMP_MAIN_PASS_END);
+        frame.timestampsWritten = true;
+
+        stats.drawCallCount += drawCallCount.load();
+        stats.triangleCount += triangleCount.load();
 
         auto end       = std::chrono::system_clock::now();
         auto elapsed   = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
@@ -499,22 +957,87 @@ namespace lumina
         vkCmdEndRendering(command);
     }
 
+    void VulkanRenderer::ReadPassTimings(FrameData& frame)
+    {
+        // Only called once the fence of the frame has signaled, so the results are available without waiting.
+        if (!frame.timestampsWritten)
+        {
+            return;
+        }
+
+        uint64_t timestamps[TIMESTAMP_COUNT];
+        const VkResult result = vkGetQueryPoolResults(
+            device,
+            frame.timestampQueryPool,
+            0,
+            TIMESTAMP_COUNT,
+            sizeof(timestamps),
+            timestamps,
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+        if (result != VK_SUCCESS)
+        {
+            return;
+        }
+
+        const float ticksToMilliseconds = timestampPeriod / 1000000.0f;
+        stats.prepassGPUTime            = static_cast<float>(timestamps[TIMESTAMP_PREPASS_END] - timestamps[TIMESTAMP_PREPASS_BEGIN]) * ticksToMilliseconds;
+        stats.mainPassGPUTime           = static_cast<float>(timestamps[TIMESTAMP_MAIN_PASS_END] - timestamps[TIMESTAMP_PREPASS_END]) * ticksToMilliseconds;
+    }
+
+    void VulkanRenderer::UpdateMemoryBudgets()
+    {
+        const VkPhysicalDeviceMemoryProperties* memoryProperties;
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+
+        heapCount = memoryProperties->memoryHeapCount;
+        vmaGetHeapBudgets(allocator, heapBudgets.data());
+    }
+
+    bool VulkanRenderer::IsDeviceLocalHeap(uint32_t heap) const
+    {
+        const VkPhysicalDeviceMemoryProperties* memoryProperties;
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+
+        return (memoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+
+    float VulkanRenderer::DeviceLocalBudgetUsage() const
+    {
+        float highestUsage = 0.0f;
+        for (uint32_t heap = 0; heap < heapCount; heap++)
+        {
+            if (IsDeviceLocalHeap(heap) && heapBudgets[heap].budget > 0)
+            {
+                highestUsage = std::max(highestUsage, static_cast<float>(heapBudgets[heap].usage) / static_cast<float>(heapBudgets[heap].budget));
+            }
+        }
+        return highestUsage;
+    }
+
     void VulkanRenderer::Shutdown()
     {
         vkDeviceWaitIdle(device);
 
+        // Unloading the scenes retires their geometry and materials, which have to go back to their pools before those are destroyed.
         loadedScenes.clear();
+        retirementQueue.Flush(device, allocator);
 
         for (auto& frame : frames)
         {
             vkDestroyCommandPool(device, frame.commandPool, nullptr);
+            for (VkCommandPool pool : frame.recordCommandPools)
+            {
+                vkDestroyCommandPool(device, pool, nullptr);
+            }
+            vkDestroyQueryPool(device, frame.timestampQueryPool, nullptr);
 
             // Destroy sync objects
             vkDestroyFence(device, frame.renderFence, nullptr);
             vkDestroySemaphore(device, frame.renderSemaphore, nullptr);
             vkDestroySemaphore(device, frame.swapchainSemaphore, nullptr);
 
-            frame.deletionQueue.Flush();
+            frame.transientAllocator.Cleanup(allocator);
         }
 
         metallicRoughnessMaterial.ClearResources(device);
@@ -577,6 +1100,7 @@ namespace lumina
         rimgAllocationInfo.requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
         vmaCreateImage(allocator, &rimgInfo, &rimgAllocationInfo, &drawImage.image, &drawImage.allocation, nullptr);
+        GPUMemory::Track(allocator, drawImage.allocation, MemoryCategory::RenderTargets);
 
         VkImageViewCreateInfo viewInfo = vkinit::ImageviewCreateInfo(drawImage.imageFormat, drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
 
@@ -590,6 +1114,7 @@ namespace lumina
         VkImageCreateInfo dimgInfo = vkinit::ImageCreateInfo(depthImage.imageFormat, depthImageUsages, depthImage.imageExtent);
 
         vmaCreateImage(allocator, &dimgInfo, &rimgAllocationInfo, &depthImage.image, &depthImage.allocation, nullptr);
+        GPUMemory::Track(allocator, depthImage.allocation, MemoryCategory::RenderTargets);
 
         VkImageViewCreateInfo dviewInfo = vkinit::ImageviewCreateInfo(depthImage.imageFormat, depthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT);
 
@@ -597,9 +1122,11 @@ namespace lumina
 
         mainDeletionQueue.PushFunction([&]() {
             vkDestroyImageView(device, drawImage.imageView, nullptr);
+            GPUMemory::Untrack(allocator, drawImage.allocation);
             vmaDestroyImage(allocator, drawImage.image, drawImage.allocation);
 
             vkDestroyImageView(device, depthImage.imageView, nullptr);
+            GPUMemory::Untrack(allocator, depthImage.allocation);
             vmaDestroyImage(allocator, depthImage.image, depthImage.allocation);
         });
     }
@@ -613,6 +1140,30 @@ namespace lumina
             VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &frame.commandPool));
             VkCommandBufferAllocateInfo commandAllocateInfo = vkinit::CommandBufferAllocateInfo(frame.commandPool, 1);
             VK_CHECK(vkAllocateCommandBuffers(device, &commandAllocateInfo, &frame.commandBuffer));
+
+            // The calling thread records a chunk as well, so there can be one more chunk than there are workers.
+            const uint32_t recordChunkCount = workerPool.WorkerCount() + 1;
+            frame.recordCommandPools.resize(recordChunkCount);
+            frame.recordCommandBuffers.resize(recordChunkCount);
+
+            frame.prepassCommandBuffers.resize(recordChunkCount);
+
+            const VkCommandPoolCreateInfo recordPoolInfo = vkinit::CommandPoolCreateInfo(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            for (uint32_t i = 0; i < recordChunkCount; i++)
+            {
+                VK_CHECK(vkCreateCommandPool(device, &recordPoolInfo, nullptr, &frame.recordCommandPools[i]));
+
+                VkCommandBufferAllocateInfo recordAllocateInfo = vkinit::CommandBufferAllocateInfo(frame.recordCommandPools[i], 1);
+                recordAllocateInfo.level                       = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                VK_CHECK(vkAllocateCommandBuffers(device, &recordAllocateInfo, &frame.recordCommandBuffers[i]));
+                VK_CHECK(vkAllocateCommandBuffers(device, &recordAllocateInfo, &frame.prepassCommandBuffers[i]));
+            }
+
+            VkQueryPoolCreateInfo queryPoolInfo {};
+            queryPoolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolInfo.queryCount = TIMESTAMP_COUNT;
+            VK_CHECK(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &frame.timestampQueryPool));
         }
 
         VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &immediateCommandPool));
@@ -685,6 +1236,11 @@ namespace lumina
             vkDestroyDescriptorSetLayout(device, imguiImageDescriptorLayout, nullptr);
         });
 
+        bindlessMaterials.Init(device, allocator);
+        mainDeletionQueue.PushFunction([&]() {
+            bindlessMaterials.Cleanup(device, allocator);
+        });
+
         for (auto& frame : frames)
         {
             std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> frameSizes = {
@@ -707,6 +1263,14 @@ namespace lumina
     {
         InitBackgroundPipelines();
         metallicRoughnessMaterial.BuildPipelines(this);
+
+        if (gpuCullingSupported)
+        {
+            gpuCulling.Init(device, FRAME_OVERLAP);
+        }
+        mainDeletionQueue.PushFunction([&]() {
+            gpuCulling.Cleanup(device, allocator);
+        });
     }
 
     void VulkanRenderer::InitBackgroundPipelines()
@@ -882,25 +1446,16 @@ namespace lumina
         materialResources.metallicRoughnessImage   = whiteImage;
         materialResources.metallicRoughnessSampler = defaultSamplerLinear;
 
-        AllocatedBuffer materialConstants =
-            CreateBuffer(allocator, sizeof(GLTFMetallicRoughness::MaterialConstants), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-        auto sceneUniformData                      = static_cast<GLTFMetallicRoughness::MaterialConstants*>(materialConstants.allocation->GetMappedData());
-        sceneUniformData->colorFactors             = float4 {1.0f, 1.0f, 1.0f, 1.0f};
-        sceneUniformData->metallicRoughnessFactors = float4 {1.0f, 0.5f, 0.0f, 0.0f};
-
-        mainDeletionQueue.PushFunction([this, materialConstants]() {
-            DestroyBuffer(allocator, materialConstants);
-        });
-
-        materialResources.dataBuffer       = materialConstants.buffer;
-        materialResources.dataBufferOffset = 0;
+        materialResources.colorFactors             = float4 {1.0f, 1.0f, 1.0f, 1.0f};
+        materialResources.metallicRoughnessFactors = float4 {1.0f, 0.5f, 0.0f, 0.0f};
 
-        defaultData.data = metallicRoughnessMaterial.WriteMaterial(device, MaterialPass::MainColor, materialResources, globalDescriptorAllocator);
+        defaultData.data = metallicRoughnessMaterial.WriteMaterial(device, MaterialPass::MainColor, materialResources, bindlessMaterials);
 
         std::string structure = {"assets/models/damaged_helmet.gltf"};
         auto structureFile    = LoadGLTF(this, structure);
         assert(structureFile.has_value());
         loadedScenes["structure"] = *structureFile;
+        loadedScenes["structure"]->Register(mainDrawContext);
     }
 
     void VulkanRenderer::CreateSwapchain(uint32_t width, uint32_t height)
@@ -961,6 +1516,7 @@ namespace lumina
         allocInfo.requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
         VK_CHECK(vmaCreateImage(allocator, &imageInfo, &allocInfo, &newImage.image, &newImage.allocation, nullptr));
+        GPUMemory::Track(allocator, newImage.allocation, MemoryCategory::Textures);
 
         VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT;
         if (format == VK_FORMAT_D32_SFLOAT)
@@ -978,55 +1534,95 @@ namespace lumina
 
     AllocatedImage VulkanRenderer::CreateImage(const void* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped)
     {
-        size_t dataSize = size.width * size.height * size.depth * 4;
-
-        AllocatedBuffer stagingBuffer = CreateBuffer(allocator, dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-        memcpy(stagingBuffer.allocationInfo.pMappedData, data, dataSize);
+        const ImageData image {data, size, format, usage, mipmapped};
+        return CreateImages(tcb::span<const ImageData>(&image, 1)).front();
+    }
 
-        AllocatedImage newImage =
-            CreateImage(size, format, usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, mipmapped);
+    std::vector<AllocatedImage> VulkanRenderer::CreateImages(tcb::span<const ImageData> images)
+    {
+        std::vector<AllocatedImage> newImages;
+        if (images.empty())
+        {
+            return newImages;
+        }
 
-        ImmediateSubmit([&](VkCommandBuffer command) {
-            vkutil::TransitionImage(command, newImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        std::vector<ImageUpload> uploads;
+        newImages.reserve(images.size());
+        uploads.reserve(images.size());
 
-            VkBufferImageCopy copyRegion {};
-            copyRegion.bufferOffset      = 0;
-            copyRegion.bufferRowLength   = 0;
-            copyRegion.bufferImageHeight = 0;
+        for (const ImageData& image : images)
+        {
+            const VkImageUsageFlags usage = image.usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            newImages.push_back(CreateImage(image.size, image.format, usage, image.mipmapped));
+            uploads.push_back(ImageUpload {newImages.back().image, image.size, 4, image.data});
+        }
 
-            copyRegion.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-            copyRegion.imageSubresource.mipLevel       = 0;
-            copyRegion.imageSubresource.baseArrayLayer = 0;
-            copyRegion.imageSubresource.layerCount     = 1;
-            copyRegion.imageExtent                     = size;
+        uploadQueue.UploadImages(uploads);
 
-            vkCmdCopyBufferToImage(command, stagingBuffer.buffer, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+        // Blits need the graphics queue, so the mip chains are built after the images have been handed over.
+        std::vector<VkImage> mipmappedImages;
+        std::vector<VkExtent2D> mipmappedSizes;
+        std::vector<VkImageMemoryBarrier2> transitions;
 
-            if (mipmapped)
-            {
-                vkutil::GenerateMipMaps(command, newImage.image, VkExtent2D {newImage.imageExtent.width, newImage.imageExtent.height});
-            }
-            else
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            if (images[i].mipmapped)
             {
-                vkutil::TransitionImage(command, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                mipmappedImages.push_back(newImages[i].image);
+                mipmappedSizes.push_back(VkExtent2D {newImages[i].imageExtent.width, newImages[i].imageExtent.height});
+                continue;
             }
-        });
 
-        DestroyBuffer(allocator, stagingBuffer);
+            VkImageMemoryBarrier2 transition {};
+            transition.sType            = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            transition.srcStageMask     = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+            transition.srcAccessMask    = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            transition.dstStageMask     = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            transition.dstAccessMask    = VK_ACCESS_2_MEMORY_READ_BIT;
+            transition.oldLayout        = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            transition.newLayout        = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            transition.image            = newImages[i].image;
+            transition.subresourceRange = vkinit::ImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT);
+            transitions.push_back(transition);
+        }
 
-        return newImage;
+        const VkCommandBuffer graphicsCommand = uploadQueue.GraphicsCommands();
+        if (!transitions.empty())
+        {
+            VkDependencyInfo dependencyInfo {};
+            dependencyInfo.sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(transitions.size());
+            dependencyInfo.pImageMemoryBarriers    = transitions.data();
+            vkCmdPipelineBarrier2(graphicsCommand, &dependencyInfo);
+        }
+        if (!mipmappedImages.empty())
+        {
+            vkutil::GenerateMipMaps(graphicsCommand, mipmappedImages, mipmappedSizes);
+        }
+
+        const UploadTicket ticket = uploadQueue.EndUpload();
+        for (AllocatedImage& image : newImages)
+        {
+            image.uploadTicket = ticket;
+        }
+
+        return newImages;
+    }
+
+    void VulkanRenderer::DestroyImage(const AllocatedImage& image)
+    {
+        retirementQueue.Retire(image, frameNumber);
     }
 
-    void VulkanRenderer::DestroyImage(const AllocatedImage& image) const
+    void VulkanRenderer::DestroySampler(VkSampler sampler)
     {
-        vkDestroyImageView(device, image.imageView, nullptr);
-        vmaDestroyImage(allocator, image.image, image.allocation);
+        retirementQueue.Retire(sampler, frameNumber);
     }
 
     void VulkanRenderer::RebuildDrawImage(VkExtent2D newExtent)
     {
         vkDestroyImageView(device, drawImage.imageView, nullptr);
+        GPUMemory::Untrack(allocator, drawImage.allocation);
         vmaDestroyImage(allocator, drawImage.image, drawImage.allocation);
 
         VkExtent3D drawImageExtent = {newExtent.width, newExtent.height, 1};
@@ -1044,6 +1640,7 @@ namespace lumina
         rimgAllocationInfo.requiredFlags = static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
         vmaCreateImage(allocator, &rimgInfo, &rimgAllocationInfo, &drawImage.image, &drawImage.allocation, nullptr);
+        GPUMemory::Track(allocator, drawImage.allocation, MemoryCategory::RenderTargets);
 
         VkImageViewCreateInfo viewInfo = vkinit::ImageviewCreateInfo(drawImage.imageFormat, drawImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
 
@@ -1060,60 +1657,74 @@ namespace lumina
 
     GPUMeshBuffers VulkanRenderer::UploadMesh(tcb::span<uint32_t> indices, tcb::span<Vertex> vertices)
     {
-        const size_t vertexBufferSize = sizeof(Vertex) * vertices.size();
-        const size_t indexBufferSize  = sizeof(uint32_t) * indices.size();
+        return UploadGeometry(indices, vertices.data(), static_cast<uint32_t>(vertices.size()), sizeof(Vertex));
+    }
 
-        GPUMeshBuffers newSurface;
+    GPUMeshBuffers VulkanRenderer::UploadMesh(tcb::span<uint32_t> indices, tcb::span<CompactVertex> vertices)
+    {
+        return UploadGeometry(indices, vertices.data(), static_cast<uint32_t>(vertices.size()), sizeof(CompactVertex));
+    }
 
-        newSurface.vertexBuffer = CreateBuffer(
-            allocator,
-            vertexBufferSize,
-            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-            VMA_MEMORY_USAGE_GPU_ONLY);
+    GPUMeshBuffers VulkanRenderer::UploadGeometry(tcb::span<uint32_t> indices, const void* vertices, uint32_t vertexCount, uint32_t vertexStride)
+    {
+        assert(vertexStride == geometryPool.VertexStride());
 
-        VkBufferDeviceAddressInfo addressInfo {};
-        addressInfo.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-        addressInfo.buffer = newSurface.vertexBuffer.buffer;
+        // Indices are relative to the mesh, so any mesh with few enough vertices can use 16 bit ones.
+        const VkIndexType indexType = vertexCount <= UINT16_MAX + 1 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        const uint32_t indexSize    = GeometryPool::IndexSize(indexType);
 
-        newSurface.vertexBufferDeviceAddress = vkGetBufferDeviceAddress(device, &addressInfo);
+        const size_t vertexBufferSize = static_cast<size_t>(vertexStride) * vertexCount;
+        const size_t indexBufferSize  = static_cast<size_t>(indexSize) * indices.size();
 
-        newSurface.indexBuffer =
-            CreateBuffer(allocator, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+        GPUMeshBuffers newSurface;
 
-        const AllocatedBuffer stagingBuffer =
-            CreateBuffer(allocator, vertexBufferSize + indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
+        const auto indexCount = static_cast<uint32_t>(indices.size());
 
-        void* data = stagingBuffer.allocationInfo.pMappedData;
+        newSurface.geometry                  = geometryPool.Allocate(vertexCount, indexCount, indexType, device, allocator);
+        newSurface.indexBuffer               = geometryPool.IndexBuffer(newSurface.geometry.block);
+        newSurface.indexType                 = indexType;
+        newSurface.vertexBufferDeviceAddress = geometryPool.VertexBufferAddress(newSurface.geometry.block);
 
-        memcpy(data, vertices.data(), vertexBufferSize);
-        memcpy(static_cast<char*>(data) + vertexBufferSize, indices.data(), indexBufferSize);
+        const void* indexData = indices.data();
+        if (indexType == VK_INDEX_TYPE_UINT16)
+        {
+            uploadIndices.resize(indices.size());
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                uploadIndices[i] = static_cast<uint16_t>(indices[i]);
+            }
+            indexData = uploadIndices.data();
+        }
 
-        ImmediateSubmit([&](VkCommandBuffer command) {
-            VkBufferCopy vertexCopy {};
-            vertexCopy.dstOffset = 0;
-            vertexCopy.srcOffset = 0;
-            vertexCopy.size      = vertexBufferSize;
+        const VkDeviceSize vertexOffset = static_cast<VkDeviceSize>(newSurface.geometry.firstVertex) * vertexStride;
+        const VkDeviceSize indexOffset  = static_cast<VkDeviceSize>(newSurface.geometry.firstIndex) * indexSize;
 
-            vkCmdCopyBuffer(command, stagingBuffer.buffer, newSurface.vertexBuffer.buffer, 1, &vertexCopy);
+        uploadQueue.UploadBuffer(geometryPool.VertexBuffer(newSurface.geometry.block), vertexOffset, vertices, vertexBufferSize);
+        uploadQueue.UploadBuffer(newSurface.indexBuffer, indexOffset, indexData, indexBufferSize);
 
-            VkBufferCopy indexCopy {};
-            indexCopy.dstOffset = 0;
-            indexCopy.srcOffset = vertexBufferSize;
-            indexCopy.size      = indexBufferSize;
+        newSurface.uploadTicket = uploadQueue.EndUpload();
 
-            vkCmdCopyBuffer(command, stagingBuffer.buffer, newSurface.indexBuffer.buffer, 1, &indexCopy);
-        });
+        return newSurface;
+    }
 
-        DestroyBuffer(allocator, stagingBuffer);
+    void VulkanRenderer::FreeMesh(const GPUMeshBuffers& buffers)
+    {
+        retirementQueue.Retire(geometryPool, buffers.geometry, frameNumber);
+    }
 
-        return newSurface;
+    void VulkanRenderer::FreeMaterial(uint32_t materialIndex)
+    {
+        retirementQueue.Retire(bindlessMaterials, materialIndex, frameNumber);
     }
 
     void VulkanRenderer::UpdateScene()
     {
         auto start = std::chrono::system_clock::now();
 
-        loadedScenes["structure"]->Draw(glm::mat4 {1.0f}, mainDrawContext);
+        for (auto& [name, scene] : loadedScenes)
+        {
+            scene->UpdateTransforms(AffineTransform::Identity());
+        }
 
         mainCamera.Update(deltaTime);
         sceneData.view = mainCamera.GetViewMatrix();
@@ -1134,15 +1745,20 @@ namespace lumina
 
     void GLTFMetallicRoughness::BuildPipelines(VulkanRenderer* renderer)
     {
+        // Every vertex shader comes in a variant for each vertex format.
+        const bool compact = renderer->compactVertices;
+
         VkShaderModule meshVertexShader;
-        if (!vkutil::LoadShaderModule("assets/shaders/mesh.vert.spv", renderer->device, &meshVertexShader))
+        if (!vkutil::LoadShaderModule(compact ? "assets/shaders/mesh_compact.vert.spv" : "assets/shaders/mesh.vert.spv", renderer->device, &meshVertexShader))
         {
             Log::Error("Error when building Mesh Vertex Shader\n");
+            abort();
         }
         VkShaderModule meshFragmentShader;
         if (!vkutil::LoadShaderModule("assets/shaders/mesh.frag.spv", renderer->device, &meshFragmentShader))
         {
             Log::Error("Error when building Mesh Fragment Shader\n");
+            abort();
         }
 
         VkPushConstantRange matrixRange {};
@@ -1150,14 +1766,7 @@ namespace lumina
         matrixRange.size       = sizeof(GPUDrawPushConstants);
         matrixRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-        DescriptorLayoutBuilder layoutBuilder;
-        layoutBuilder.AddBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        layoutBuilder.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-        layoutBuilder.AddBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-        materialSetLayout = layoutBuilder.Build(renderer->device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
-
-        VkDescriptorSetLayout setLayouts[] = {renderer->gpuSceneDataDescriptorLayout, materialSetLayout};
+        VkDescriptorSetLayout setLayouts[] = {renderer->gpuSceneDataDescriptorLayout, renderer->bindlessMaterials.Layout()};
 
         VkPipelineLayoutCreateInfo meshLayoutInfo = vkinit::PipelineLayoutCreateInfo();
         meshLayoutInfo.setLayoutCount             = 2;
@@ -1186,28 +1795,66 @@ namespace lumina
         pipelineBuilder.pipelineLayout = newLayout;
         opaquePipeline.pipeline        = pipelineBuilder.BuildPipeline(renderer->device);
 
+        // Without the indirect variant opaque surfaces simply stay on the regular draw path.
+        VkShaderModule indirectVertexShader;
+        const char* indirectVertexPath = compact ? "assets/shaders/mesh_indirect_compact.vert.spv" : "assets/shaders/mesh_indirect.vert.spv";
+        if (vkutil::LoadShaderModule(indirectVertexPath, renderer->device, &indirectVertexShader))
+        {
+            pipelineBuilder.SetShaders(indirectVertexShader, meshFragmentShader);
+            opaquePipeline.indirectPipeline = pipelineBuilder.BuildPipeline(renderer->device);
+            pipelineBuilder.SetShaders(meshVertexShader, meshFragmentShader);
+            vkDestroyShaderModule(renderer->device, indirectVertexShader, nullptr);
+        }
+        else
+        {
+            Log::Error("Error when building Indirect Mesh Vertex Shader\n");
+        }
+
+        // Behind a depth prepass the depth buffer already holds the final opaque depth, so shading only has to match it.
+        pipelineBuilder.EnableDepthTest(false, VK_COMPARE_OP_EQUAL);
+        opaquePipeline.depthEqualPipeline = pipelineBuilder.BuildPipeline(renderer->device);
+
         pipelineBuilder.EnableBlendingAdditive();
         pipelineBuilder.EnableDepthTest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
         transparentPipeline.pipeline = pipelineBuilder.BuildPipeline(renderer->device);
 
+        VkShaderModule depthVertexShader;
+        const char* depthVertexPath = compact ? "assets/shaders/mesh_depth_compact.vert.spv" : "assets/shaders/mesh_depth.vert.spv";
+        if (vkutil::LoadShaderModule(depthVertexPath, renderer->device, &depthVertexShader))
+        {
+            pipelineBuilder.SetVertexShader(depthVertexShader);
+            pipelineBuilder.DisableColorAttachment();
+            pipelineBuilder.EnableDepthTest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+            opaquePipeline.depthPrepassPipeline = pipelineBuilder.BuildPipeline(renderer->device);
+            vkDestroyShaderModule(renderer->device, depthVertexShader, nullptr);
+        }
+        else
+        {
+            Log::Error("Error when building Depth Prepass Vertex Shader\n");
+        }
+
         vkDestroyShaderModule(renderer->device, meshVertexShader, nullptr);
         vkDestroyShaderModule(renderer->device, meshFragmentShader, nullptr);
     }
 
     void GLTFMetallicRoughness::ClearResources(VkDevice device) const
     {
-        vkDestroyDescriptorSetLayout(device, materialSetLayout, nullptr);
         vkDestroyPipelineLayout(device, transparentPipeline.pipelineLayout, nullptr);
 
         vkDestroyPipeline(device, transparentPipeline.pipeline, nullptr);
         vkDestroyPipeline(device, opaquePipeline.pipeline, nullptr);
+        if (opaquePipeline.indirectPipeline != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(device, opaquePipeline.indirectPipeline, nullptr);
+        }
+        if (opaquePipeline.depthPrepassPipeline != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(device, opaquePipeline.depthPrepassPipeline, nullptr);
+        }
+        vkDestroyPipeline(device, opaquePipeline.depthEqualPipeline, nullptr);
     }
 
-    MaterialInstance GLTFMetallicRoughness::WriteMaterial(
-        VkDevice device,
-        MaterialPass pass,
-        const MaterialResources& resources,
-        DescriptorAllocatorGrowable& descriptorAllocator)
+    MaterialInstance GLTFMetallicRoughness::WriteMaterial(VkDevice device, MaterialPass pass, const MaterialResources& resources, BindlessMaterials& materials)
     {
         MaterialInstance materialData;
         materialData.passType = pass;
@@ -1220,52 +1867,60 @@ namespace lumina
             materialData.pipeline = &opaquePipeline;
         }
 
-        materialData.materialSet = descriptorAllocator.Allocate(device, materialSetLayout);
+        GPUMaterialData constants {};
+        constants.colorFactors             = resources.colorFactors;
+        constants.metallicRoughnessFactors = resources.metallicRoughnessFactors;
 
-        writer.Clear();
-        writer.WriteBuffer(0, resources.dataBuffer, sizeof(MaterialConstants), resources.dataBufferOffset, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        writer.WriteImage(
-            1,
+        materialData.materialIndex = materials.AddMaterial(
+            device,
+            constants,
             resources.colorImage.imageView,
             resources.colorSampler,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-        writer.WriteImage(
-            2,
             resources.metallicRoughnessImage.imageView,
-            resources.metallicRoughnessSampler,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-        writer.UpdateSet(device, materialData.materialSet);
+            resources.metallicRoughnessSampler);
 
         return materialData;
     }
 
-    void MeshNode::Draw(const glm::mat4& topMatrix, DrawContext& context)
+    void MeshNode::RegisterSelf(DrawContext& context)
     {
-        glm::mat4 nodeMatrix = topMatrix * worldTransform;
+        UnregisterSelf(context);
+        surfaceHandles.reserve(mesh->surfaces.size());
 
         for (auto& surface : mesh->surfaces)
         {
             RenderObject def;
             def.indexCount                = surface.indexCount;
             def.firstIndex                = surface.startIndex;
-            def.indexBuffer               = mesh->buffers.indexBuffer.buffer;
+            def.indexBuffer               = mesh->buffers.indexBuffer;
+            def.indexType                 = mesh->buffers.indexType;
+            def.indexOffset               = mesh->buffers.geometry.firstIndex;
+            def.vertexOffset              = static_cast<int32_t>(mesh->buffers.geometry.firstVertex);
             def.material                  = &surface.material->data;
             def.bounds                    = surface.bounds;
-            def.transform                 = nodeMatrix;
+            def.transform                 = worldTransform;
             def.vertexBufferDeviceAddress = mesh->buffers.vertexBufferDeviceAddress;
+            def.occluder                  = mesh->occluder.get();
+            def.lods                      = surface.lods;
 
-            if (surface.material->data.passType == MaterialPass::Transparent)
-            {
-                context.transparentSurfaces.push_back(def);
-            }
-            else
-            {
-                context.opaqueSurfaces.push_back(def);
-            }
+            surfaceHandles.push_back(context.Register(def));
+        }
+    }
+
+    void MeshNode::UnregisterSelf(DrawContext& context)
+    {
+        for (const auto& handle : surfaceHandles)
+        {
+            context.Unregister(handle);
+        }
+        surfaceHandles.clear();
+    }
+
+    void MeshNode::OnWorldTransformChanged(DrawContext& context)
+    {
+        for (const auto& handle : surfaceHandles)
+        {
+            context.SetTransform(handle, worldTransform);
         }
-        Node::Draw(topMatrix, context);
     }
 } // namespace lumina
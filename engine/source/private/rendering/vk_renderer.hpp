@@ -1,10 +1,21 @@
 ﻿#pragma once
+#include "bindless_materials.hpp"
 #include "camera.hpp"
+#include "core/thread_pool.hpp"
 #include "core/types.hpp"
+#include "draw_context.hpp"
+#include "geometry_pool.hpp"
+#include "gpu_culling.hpp"
+#include "gpu_memory.hpp"
+#include "occlusion_culling.hpp"
+#include "retirement_queue.hpp"
+#include "transient_allocator.hpp"
+#include "upload_queue.hpp"
 #include "vk_descriptors.hpp"
 #include "vk_loader.hpp"
 #include "vk_types.hpp"
 
+#include <array>
 #include <deque>
 #include <functional>
 #include <memory>
@@ -43,8 +54,27 @@ namespace lumina
         VkSemaphore swapchainSemaphore {};
         VkSemaphore renderSemaphore {};
         VkFence renderFence {};
-        DeletionQueue deletionQueue {};
         std::unique_ptr<DescriptorAllocatorGrowable> frameDescriptors {};
+        TransientAllocator transientAllocator {};
+
+        // One pool and secondary command buffer per recording chunk, so no two threads ever record from the same pool.
+        std::vector<VkCommandPool> recordCommandPools {};
+        std::vector<VkCommandBuffer> recordCommandBuffers {};
+        std::vector<VkCommandBuffer> prepassCommandBuffers {};
+
+        // Timestamps around the depth prepass and the main pass, indexed by the TIMESTAMP_ constants.
+        VkQueryPool timestampQueryPool {};
+        bool timestampsWritten {false};
+    };
+
+    // Source of an image created from memory, data holds tightly packed RGBA8 texels for mip 0.
+    struct ImageData
+    {
+        const void* data;
+        VkExtent3D size;
+        VkFormat format;
+        VkImageUsageFlags usage;
+        bool mipmapped;
     };
 
     struct ComputePushConstants
@@ -79,39 +109,31 @@ namespace lumina
         MaterialPipeline opaquePipeline;
         MaterialPipeline transparentPipeline;
 
-        VkDescriptorSetLayout materialSetLayout;
-
-        struct MaterialConstants
-        {
-            float4 colorFactors;
-            float4 metallicRoughnessFactors;
-            float4 padding[14];
-        };
-
         struct MaterialResources
         {
             AllocatedImage colorImage;
             VkSampler colorSampler;
             AllocatedImage metallicRoughnessImage;
             VkSampler metallicRoughnessSampler;
-            VkBuffer dataBuffer;
-            uint32_t dataBufferOffset;
+            float4 colorFactors;
+            float4 metallicRoughnessFactors;
         };
 
-        DescriptorWriter writer;
-
         void BuildPipelines(VulkanRenderer* renderer);
         void ClearResources(VkDevice device) const;
 
-        MaterialInstance
-            WriteMaterial(VkDevice device, MaterialPass pass, const MaterialResources& resources, DescriptorAllocatorGrowable& descriptorAllocator);
+        // Adds the material to the bindless material table, the returned instance only refers to it by index.
+        MaterialInstance WriteMaterial(VkDevice device, MaterialPass pass, const MaterialResources& resources, BindlessMaterials& materials);
     };
 
     struct MeshNode : public Node
     {
         std::shared_ptr<MeshAsset> mesh;
+        std::vector<RenderObjectHandle> surfaceHandles;
 
-        void Draw(const glm::mat4& topMatrix, DrawContext& context) override;
+        void RegisterSelf(DrawContext& context) override;
+        void UnregisterSelf(DrawContext& context) override;
+        void OnWorldTransformChanged(DrawContext& context) override;
     };
 
     struct RendererStats
@@ -119,11 +141,25 @@ namespace lumina
         float frameTime {};
         float sceneUpdateTime {};
         float drawTime {};
+        float cullTime {};
+        float sortTime {};
+        float prepassGPUTime {};
+        float mainPassGPUTime {};
         int triangleCount {};
         int drawCallCount {};
+        int occludedCount {};
+        int contributionCulledCount {};
     };
 
-    constexpr uint8_t FRAME_OVERLAP = 2;
+    constexpr uint8_t FRAME_OVERLAP       = 2;
+    constexpr uint32_t CULLING_CHUNK_SIZE = 4096;
+    constexpr uint32_t RECORD_CHUNK_SIZE  = 1024;
+
+    // Queries of the per-frame timestamp pool.
+    constexpr uint32_t TIMESTAMP_PREPASS_BEGIN = 0;
+    constexpr uint32_t TIMESTAMP_PREPASS_END   = 1;
+    constexpr uint32_t TIMESTAMP_MAIN_PASS_END = 2;
+    constexpr uint32_t TIMESTAMP_COUNT         = 3;
 
     class VulkanRenderer
     {
@@ -156,8 +192,17 @@ namespace lumina
         FrameData frames[FRAME_OVERLAP];
         VkQueue graphicsQueue {};
         uint32_t graphicsQueueFamily {};
+        // Nanoseconds per timestamp tick on the graphics queue.
+        float timestampPeriod {};
+        // Whether the device has the optional features GPU driven culling needs.
+        bool gpuCullingSupported {false};
+
+        std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> heapBudgets {};
+        uint32_t heapCount {0};
 
         DeletionQueue mainDeletionQueue {};
+        // Resources released while frames are in flight, tagged with frameNumber.
+        RetirementQueue retirementQueue {};
 
         VmaAllocator allocator {};
         DescriptorAllocatorGrowable globalDescriptorAllocator {};
@@ -198,6 +243,20 @@ namespace lumina
 
         bool enableOpaqueSorting {false};
         bool enableCPUFrustumCulling {false};
+        bool enableParallelCulling {true};
+        bool enableHierarchicalCulling {true};
+        bool enableOcclusionCulling {false};
+        int maxOccluders {32};
+        bool enableContributionCulling {false};
+        float minPixelCoverage {4.0f};
+        bool enableGPUDrivenCulling {false};
+        bool enableLodSelection {true};
+        float lodPixelError {1.0f};
+        bool enableInstancing {true};
+        bool enableParallelRecording {true};
+        bool enableDepthPrepass {false};
+        // Read when the renderer is initialized, selects the vertex format of every mesh and the shaders that pull it.
+        bool compactVertices {true};
 
         void Initialize();
         void Run();
@@ -205,12 +264,22 @@ namespace lumina
         void Shutdown();
 
         void ImmediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
+        // The vertex format has to match compactVertices.
         GPUMeshBuffers UploadMesh(tcb::span<uint32_t> indices, tcb::span<Vertex> vertices);
+        GPUMeshBuffers UploadMesh(tcb::span<uint32_t> indices, tcb::span<CompactVertex> vertices);
+        // The ranges go back to the geometry pool once the frames in flight are done with them.
+        void FreeMesh(const GPUMeshBuffers& buffers);
+        // The bindless slot and its textures are released once the frames in flight are done with them.
+        void FreeMaterial(uint32_t materialIndex);
         void UpdateScene();
 
         AllocatedImage CreateImage(VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false) const;
         AllocatedImage CreateImage(const void* data, VkExtent3D size, VkFormat format, VkImageUsageFlags usage, bool mipmapped = false);
-        void DestroyImage(const AllocatedImage& image) const;
+        // Uploads every image in one batch, with the copies and mip chains of all of them sharing their barriers.
+        std::vector<AllocatedImage> CreateImages(tcb::span<const ImageData> images);
+        // Destroyed once the frames in flight are done with it.
+        void DestroyImage(const AllocatedImage& image);
+        void DestroySampler(VkSampler sampler);
 
         void RebuildDrawImage(VkExtent2D newExtent);
 
@@ -230,6 +299,36 @@ namespace lumina
 
         RendererStats stats;
 
+        // Usage and budget of every memory heap, refreshed once per frame. Budgets are estimates without VK_EXT_memory_budget.
+        [[nodiscard]] tcb::span<const VmaBudget> HeapBudgets() const
+        {
+            return tcb::span<const VmaBudget>(heapBudgets.data(), heapCount);
+        }
+
+        [[nodiscard]] bool IsDeviceLocalHeap(uint32_t heap) const;
+        // Highest usage to budget ratio of the device local heaps, above 1 allocations are likely to fail or get evicted.
+        [[nodiscard]] float DeviceLocalBudgetUsage() const;
+
+        ThreadPool workerPool;
+        std::vector<uint32_t> cullChunkBegins;
+        std::vector<uint32_t> cullChunkCounts;
+        std::vector<uint32_t> cullSubtrees;
+
+        std::vector<uint64_t> drawSortKeys;
+        std::vector<uint64_t> drawSortScratchKeys;
+        std::vector<uint32_t> drawSortScratchIndices;
+        std::vector<const RenderObject*> orderedDraws;
+
+        OcclusionBuffer occlusionBuffer;
+        std::vector<std::pair<float, uint32_t>> occluderCandidates;
+
+        GPUCulling gpuCulling;
+        GeometryPool geometryPool;
+        UploadQueue uploadQueue;
+        // Indices of the mesh being uploaded, narrowed to 16 bits.
+        std::vector<uint16_t> uploadIndices;
+        BindlessMaterials bindlessMaterials;
+
     private:
         void InitVulkan();
         void InitSwapchain();
@@ -242,9 +341,14 @@ namespace lumina
 
         void InitDefaultData();
 
+        GPUMeshBuffers UploadGeometry(tcb::span<uint32_t> indices, const void* vertices, uint32_t vertexCount, uint32_t vertexStride);
+
         void DrawBackground(VkCommandBuffer command);
         void DrawGeometry(VkCommandBuffer command);
+        void CullOccluded(std::vector<uint32_t>& draws, uint32_t chunkSize);
         void DrawImGui(VkCommandBuffer command, VkImageView targetImageView);
+        void ReadPassTimings(FrameData& frame);
+        void UpdateMemoryBudgets();
 
         void CreateSwapchain(uint32_t width, uint32_t height);
         void ResizeSwapchain();
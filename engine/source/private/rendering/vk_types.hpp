@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "core/affine_transform.hpp"
+#include "core/span.hpp"
 #include "core/types.hpp"
 
 #include <array>
@@ -30,6 +32,9 @@ namespace lumina
         }                                                                         \
     } while (0)
 
+    // Timeline value of the UploadQueue batch that fills a resource, the resource is ready once the upload semaphore reaches it.
+    using UploadTicket = uint64_t;
+
     struct AllocatedImage
     {
         VkImage image;
@@ -37,6 +42,7 @@ namespace lumina
         VmaAllocation allocation;
         VkExtent3D imageExtent;
         VkFormat imageFormat;
+        UploadTicket uploadTicket {0};
     };
 
     struct AllocatedBuffer
@@ -55,17 +61,51 @@ namespace lumina
         float4 color;
     };
 
+    /**
+     * Quantized alternative to Vertex, matching the COMPACT_VERTICES layout in vertex_pulling.glsl.
+     * Positions are unorm16 within the bounds of their surface, which the draw passes along to decode them. Normals are
+     * octahedral encoded into two snorm8, UVs are half floats and the color is unorm8.
+     */
+    struct CompactVertex
+    {
+        uint32_t positionXY;
+        uint32_t positionZNormal;
+        uint32_t uv;
+        uint32_t color;
+    };
+
+    // Ranges of a mesh inside one block of the geometry pool, counted in vertices and in indices of indexType.
+    struct GeometryAllocation
+    {
+        uint32_t block {UINT32_MAX};
+        uint32_t firstIndex {0};
+        uint32_t indexCount {0};
+        uint32_t firstVertex {0};
+        uint32_t vertexCount {0};
+        VkIndexType indexType {VK_INDEX_TYPE_UINT32};
+    };
+
+    // Indices stay relative to the mesh, draws add firstVertex as their vertex offset.
     struct GPUMeshBuffers
     {
-        AllocatedBuffer indexBuffer;
-        AllocatedBuffer vertexBuffer;
+        GeometryAllocation geometry;
+        VkBuffer indexBuffer;
+        VkIndexType indexType;
         VkDeviceAddress vertexBufferDeviceAddress;
+        UploadTicket uploadTicket {0};
     };
 
+    // The world matrix of each instance is read from the instance buffer at gl_InstanceIndex.
     struct GPUDrawPushConstants
     {
-        glm::mat4 worldMatrix;
+        VkDeviceAddress instanceBufferDeviceAddress;
         VkDeviceAddress vertexBufferDeviceAddress;
+        uint32_t materialIndex;
+        uint32_t padding[3];
+
+        // Surface bounds that compact vertex positions are decoded against.
+        float4 positionOrigin;
+        float4 positionExtents;
     };
 
     enum class MaterialPass : uint8_t
@@ -79,12 +119,19 @@ namespace lumina
     {
         VkPipeline pipeline;
         VkPipelineLayout pipelineLayout;
+
+        // Variant that reads its transform from the GPU culling object buffer, null if the pass can't be drawn indirectly.
+        VkPipeline indirectPipeline {VK_NULL_HANDLE};
+
+        // Depth only variant for the depth prepass and the variant that shades against its depth, null if the pass skips the prepass.
+        VkPipeline depthPrepassPipeline {VK_NULL_HANDLE};
+        VkPipeline depthEqualPipeline {VK_NULL_HANDLE};
     };
 
     struct MaterialInstance
     {
         MaterialPipeline* pipeline;
-        VkDescriptorSet materialSet;
+        uint32_t materialIndex;
         MaterialPass passType;
     };
 
@@ -95,27 +142,50 @@ namespace lumina
         float3 extents;
     };
 
+    // CPU copy of the triangles of a mesh, used for software occlusion culling.
+    struct OccluderGeometry
+    {
+        std::vector<float3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    // Index range of one detail level of a surface, with its simplification error as an object space distance.
+    struct MeshLod
+    {
+        uint32_t startIndex;
+        uint32_t indexCount;
+        float error;
+    };
+
     struct RenderObject
     {
         uint32_t indexCount;
         uint32_t firstIndex;
         VkBuffer indexBuffer;
+        VkIndexType indexType;
+
+        // Start of the mesh in the shared geometry buffers, firstIndex and the LOD ranges are relative to it.
+        uint32_t indexOffset;
+        int32_t vertexOffset;
 
         MaterialInstance* material;
         Bounds bounds;
-        glm::mat4 transform;
+        AffineTransform transform;
         VkDeviceAddress vertexBufferDeviceAddress;
-    };
 
-    struct DrawContext
-    {
-        std::vector<RenderObject> opaqueSurfaces;
-        std::vector<RenderObject> transparentSurfaces;
+        // Only set for surfaces of meshes simple enough to be rasterized as occluders.
+        const OccluderGeometry* occluder {nullptr};
+
+        // Detail levels from full to coarsest, empty for surfaces that are always drawn at full detail.
+        tcb::span<const MeshLod> lods {};
     };
 
+    class DrawContext;
+
     class IRenderable
     {
-        virtual void Draw(const glm::mat4& topMatrix, DrawContext& context) = 0;
+        virtual void Register(DrawContext& context)   = 0;
+        virtual void Unregister(DrawContext& context) = 0;
     };
 
     struct Node : public IRenderable
@@ -123,10 +193,13 @@ namespace lumina
         std::weak_ptr<Node> parent;
         std::vector<std::shared_ptr<Node>> children;
 
-        glm::mat4 localTransform;
-        glm::mat4 worldTransform;
+        AffineTransform localTransform;
+        AffineTransform worldTransform;
+
+        // Slot in the owning scene's flat TransformHierarchy, UINT32_MAX when the node is not part of one.
+        uint32_t transformIndex {UINT32_MAX};
 
-        void RefreshTransforms(const glm::mat4& parentMatrix)
+        void RefreshTransforms(const AffineTransform& parentMatrix)
         {
             worldTransform = parentMatrix * localTransform;
             for (const auto& child : children)
@@ -135,13 +208,28 @@ namespace lumina
             }
         }
 
-        void Draw(const glm::mat4& topMatrix, DrawContext& context) override
+        void Register(DrawContext& context) override
         {
-            for (auto& child : children)
+            RegisterSelf(context);
+            for (const auto& child : children)
+            {
+                child->Register(context);
+            }
+        }
+
+        void Unregister(DrawContext& context) override
+        {
+            UnregisterSelf(context);
+            for (const auto& child : children)
             {
-                child->Draw(topMatrix, context);
+                child->Unregister(context);
             }
         }
+
+        // Hooks for this node alone, children are not visited. Scenes with a flat TransformHierarchy call these directly.
+        virtual void RegisterSelf(DrawContext& /*context*/) {}
+        virtual void UnregisterSelf(DrawContext& /*context*/) {}
+        virtual void OnWorldTransformChanged(DrawContext& /*context*/) {}
     };
 
 } // namespace lumina
@@ -0,0 +1,112 @@
+﻿#pragma once
+
+#include "core/simd.hpp"
+#include "core/types.hpp"
+
+#include <glm/mat4x4.hpp>
+
+namespace lumina
+{
+    /**
+     * Affine transform stored as the top three rows of a 4x4 matrix, the fourth row is implicitly (0, 0, 0, 1).
+     * Every row holds the linear part in xyz and the translation in w. This is the memory layout of a std430 mat3x4, so the
+     * transform is uploaded as is and shaders rebuild the full matrix with AffineToMatrix.
+     */
+    struct alignas(16) AffineTransform
+    {
+        float4 rows[3] {float4 {1.0f, 0.0f, 0.0f, 0.0f}, float4 {0.0f, 1.0f, 0.0f, 0.0f}, float4 {0.0f, 0.0f, 1.0f, 0.0f}};
+
+        static AffineTransform Identity()
+        {
+            return {};
+        }
+
+        static AffineTransform FromTranslation(const float3& translation)
+        {
+            AffineTransform transform;
+            transform.rows[0].w = translation.x;
+            transform.rows[1].w = translation.y;
+            transform.rows[2].w = translation.z;
+            return transform;
+        }
+
+        // The fourth row of matrix is dropped, it has to be (0, 0, 0, 1) for the result to be equivalent.
+        static AffineTransform FromMatrix(const glm::mat4& matrix)
+        {
+            AffineTransform transform;
+            for (int row = 0; row < 3; row++)
+            {
+                transform.rows[row] = float4 {matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]};
+            }
+            return transform;
+        }
+
+        [[nodiscard]] glm::mat4 ToMatrix() const
+        {
+            return glm::transpose(glm::mat4 {rows[0], rows[1], rows[2], float4 {0.0f, 0.0f, 0.0f, 1.0f}});
+        }
+
+        // Column of the linear part, the image of the given unit axis.
+        [[nodiscard]] float3 Axis(int index) const
+        {
+            return float3 {rows[0][index], rows[1][index], rows[2][index]};
+        }
+
+        [[nodiscard]] float3 Translation() const
+        {
+            return Axis(3);
+        }
+
+        [[nodiscard]] float3 TransformPoint(const float3& point) const
+        {
+            const float4 p {point, 1.0f};
+            return float3 {glm::dot(rows[0], p), glm::dot(rows[1], p), glm::dot(rows[2], p)};
+        }
+
+        [[nodiscard]] float3 TransformVector(const float3& vector) const
+        {
+            const float4 v {vector, 0.0f};
+            return float3 {glm::dot(rows[0], v), glm::dot(rows[1], v), glm::dot(rows[2], v)};
+        }
+
+        bool operator==(const AffineTransform& other) const
+        {
+            return rows[0] == other.rows[0] && rows[1] == other.rows[1] && rows[2] == other.rows[2];
+        }
+
+        bool operator!=(const AffineTransform& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    // Composes two transforms, applying b first. Every result row is three multiply-adds of the rows of b.
+    inline AffineTransform operator*(const AffineTransform& a, const AffineTransform& b)
+    {
+        AffineTransform result;
+#if defined(LUMINA_SIMD_SSE)
+        const __m128 b0              = _mm_loadu_ps(&b.rows[0].x);
+        const __m128 b1              = _mm_loadu_ps(&b.rows[1].x);
+        const __m128 b2              = _mm_loadu_ps(&b.rows[2].x);
+        const __m128 translationMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+        for (int i = 0; i < 3; i++)
+        {
+            const __m128 row = _mm_loadu_ps(&a.rows[i].x);
+
+            __m128 value = _mm_and_ps(row, translationMask);
+            value        = _mm_add_ps(value, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b0));
+            value        = _mm_add_ps(value, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+            value        = _mm_add_ps(value, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+            _mm_storeu_ps(&result.rows[i].x, value);
+        }
+#else
+        for (int i = 0; i < 3; i++)
+        {
+            const float4& row = a.rows[i];
+            result.rows[i]    = row.x * b.rows[0] + row.y * b.rows[1] + row.z * b.rows[2] + float4 {0.0f, 0.0f, 0.0f, row.w};
+        }
+#endif
+        return result;
+    }
+} // namespace lumina
@@ -0,0 +1,16 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace lumina
+{
+    /**
+     * Stable least significant digit radix sort of 64-bit keys, moving a 32-bit value along with every key.
+     * Keys are processed eleven bits at a time. All histograms are built in a single pass up front, and digits that are the
+     * same for every key are skipped, so keys that leave their upper bits unused only pay for the bits they use.
+     *
+     * The scratch vectors are resized as needed and can be kept around between calls to avoid reallocating.
+     */
+    void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, std::vector<uint64_t>& scratchKeys, std::vector<uint32_t>& scratchValues);
+} // namespace lumina
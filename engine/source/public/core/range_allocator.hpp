@@ -0,0 +1,47 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace lumina
+{
+    /**
+     * Offset based allocator for suballocating ranges out of a fixed capacity, for example elements of a GPU buffer.
+     * Free ranges are kept sorted by offset so a freed range is merged with its neighbours right away. Allocations take the
+     * smallest free range they fit in, which keeps the large ranges intact for large meshes.
+     *
+     * The allocator only does the bookkeeping, it never touches the memory it hands out.
+     */
+    class RangeAllocator
+    {
+    public:
+        static constexpr uint32_t INVALID_OFFSET = UINT32_MAX;
+
+        explicit RangeAllocator(uint32_t initialCapacity = 0);
+
+        // Returns the offset of the allocated range, or INVALID_OFFSET if no free range is large enough.
+        uint32_t Allocate(uint32_t size);
+        void Free(uint32_t offset, uint32_t size);
+
+        [[nodiscard]] uint32_t Capacity() const
+        {
+            return capacity;
+        }
+
+        [[nodiscard]] uint32_t FreeSpace() const
+        {
+            return freeSpace;
+        }
+
+    private:
+        struct Range
+        {
+            uint32_t offset;
+            uint32_t size;
+        };
+
+        std::vector<Range> freeRanges;
+        uint32_t capacity {0};
+        uint32_t freeSpace {0};
+    };
+} // namespace lumina
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+// SSE2 is part of the x86_64 baseline, wider instruction sets are selected at runtime with HasAVX2().
+#if defined(_M_X64) || defined(__x86_64__)
+    #define LUMINA_SIMD_SSE 1
+    #include <immintrin.h>
+
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        // MSVC allows AVX2 intrinsics in any function, no per-function target is needed.
+        #define LUMINA_TARGET_AVX2
+    #else
+        #define LUMINA_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+namespace lumina
+{
+    namespace simd
+    {
+        inline bool HasAVX2()
+        {
+#if defined(LUMINA_SIMD_SSE) && defined(_MSC_VER) && !defined(__clang__)
+            static const bool supported = [] {
+                int info[4];
+                __cpuid(info, 0);
+                if (info[0] < 7)
+                {
+                    return false;
+                }
+
+                // The OS has to save the YMM registers as well, not only the CPU has to support them.
+                __cpuid(info, 1);
+                const bool osxsave = (info[2] & (1 << 27)) != 0;
+                const bool avx     = (info[2] & (1 << 28)) != 0;
+                if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+                {
+                    return false;
+                }
+
+                __cpuidex(info, 7, 0);
+                return (info[1] & (1 << 5)) != 0;
+            }();
+            return supported;
+#elif defined(LUMINA_SIMD_SSE)
+            static const bool supported = __builtin_cpu_supports("avx2");
+            return supported;
+#else
+            return false;
+#endif
+        }
+    } // namespace simd
+} // namespace lumina
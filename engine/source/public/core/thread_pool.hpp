@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lumina
+{
+    /**
+     * Fixed set of worker threads that split a range of work into chunks.
+     * The calling thread works on chunks as well and ParallelFor only returns once every chunk is done,
+     * so the work items can safely reference data on the caller's stack.
+     *
+     * Chunks are handed out in order through an atomic counter. Work that needs per-chunk output should
+     * index it with the chunk index instead of sharing a container, which keeps the merge free of locks.
+     */
+    class ThreadPool
+    {
+    public:
+        using ChunkFunction = std::function<void(uint32_t begin, uint32_t end, uint32_t chunkIndex)>;
+
+        explicit ThreadPool(uint32_t workerCount = DefaultWorkerCount());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&)            = delete;
+        ThreadPool(ThreadPool&&)                 = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ThreadPool& operator=(ThreadPool&&)      = delete;
+
+        // Calls function for every chunk of [0, count), should only be called from one thread at a time.
+        void ParallelFor(uint32_t count, uint32_t chunkSize, const ChunkFunction& function);
+
+        [[nodiscard]] uint32_t WorkerCount() const
+        {
+            return static_cast<uint32_t>(workers.size());
+        }
+
+        [[nodiscard]] static uint32_t ChunkCount(uint32_t count, uint32_t chunkSize)
+        {
+            return (count + chunkSize - 1) / chunkSize;
+        }
+
+        // One thread less than the hardware has, the calling thread is the remaining one.
+        [[nodiscard]] static uint32_t DefaultWorkerCount();
+
+    private:
+        void WorkerLoop();
+        void RunChunks();
+
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable workFinished;
+        uint64_t generation {0};
+        uint32_t activeWorkers {0};
+        bool stopping {false};
+
+        const ChunkFunction* function {nullptr};
+        uint32_t count {0};
+        uint32_t chunkSize {0};
+        uint32_t chunkCount {0};
+        std::atomic<uint32_t> nextChunk {0};
+        std::atomic<uint32_t> finishedChunks {0};
+    };
+} // namespace lumina
@@ -44,6 +44,11 @@ project "Engine"
         "vulkan-1.lib",
     }
 
+    -- Runs glslangValidator -V on every shader stage before each build, the SPIR-V next to the sources is a build output
+    prebuildcommands {
+        'for %%f in (assets\\shaders\\*.vert assets\\shaders\\*.frag assets\\shaders\\*.comp) do ("$(VULKAN_SDK)\\Bin\\glslangValidator.exe" -V "%%f" -o "%%f.spv" || exit /b 1)',
+    }
+
     filter "configurations:Debug"
         defines { "_DEBUG", "GLM_FORCE_DEPTH_ZERO_TO_ONE" }
         runtime "Debug"